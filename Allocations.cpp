@@ -0,0 +1,155 @@
+#include "Allocations.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static const size_t phase_count = size_t(AllocationPhase::Count);
+
+// Constant initialized, operator new may run before dynamic initialization
+static std::atomic<bool> enabled = { false };
+static std::atomic<int> current_phase = { int(AllocationPhase::Idle) };
+static std::atomic<uint64_t> allocations[phase_count];
+static std::atomic<uint64_t> bytes[phase_count];
+
+static void* allocate(std::size_t size)
+{
+  if (enabled.load(std::memory_order_relaxed))
+  {
+    int phase = current_phase.load(std::memory_order_relaxed);
+    allocations[phase].fetch_add(1, std::memory_order_relaxed);
+    bytes[phase].fetch_add(size, std::memory_order_relaxed);
+  }
+
+  if (size == 0)
+    size = 1;
+  for (;;)
+  {
+    void* p = malloc(size);
+    if (p)
+      return p;
+
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+  return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return allocate(size);
+  }
+  catch (const std::bad_alloc&)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return allocate(size);
+  }
+  catch (const std::bad_alloc&)
+  {
+    return nullptr;
+  }
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  free(p);
+}
+
+void AllocationTracker::set_enabled(bool enabled)
+{
+  ::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool AllocationTracker::is_enabled()
+{
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::set_phase(AllocationPhase phase)
+{
+  current_phase.store(int(phase), std::memory_order_relaxed);
+}
+
+AllocationPhase AllocationTracker::get_phase()
+{
+  return AllocationPhase(current_phase.load(std::memory_order_relaxed));
+}
+
+AllocationCount AllocationTracker::get_count(AllocationPhase phase)
+{
+  AllocationCount count;
+  count.allocations = allocations[size_t(phase)].load(std::memory_order_relaxed);
+  count.bytes = bytes[size_t(phase)].load(std::memory_order_relaxed);
+  return count;
+}
+
+AllocationCount AllocationTracker::get_total()
+{
+  AllocationCount total;
+  for (size_t i = 0; i < phase_count; ++i)
+  {
+    AllocationCount count = get_count(AllocationPhase(i));
+    total.allocations += count.allocations;
+    total.bytes += count.bytes;
+  }
+  return total;
+}
+
+void AllocationTracker::reset()
+{
+  for (size_t i = 0; i < phase_count; ++i)
+  {
+    allocations[i] = 0;
+    bytes[i] = 0;
+  }
+}
+
+const char* AllocationTracker::get_phase_name(AllocationPhase phase)
+{
+  static const char* names[phase_count] = { "idle", "control", "update", "record", "render" };
+  return size_t(phase) < phase_count ? names[size_t(phase)] : "unknown";
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Part of the game loop, heap allocations are counted per phase
+enum class AllocationPhase
+{
+  Idle,       // Outside the phases below, e.g. start up and the backend's own loop
+  Control,
+  Update,
+  Record,     // Recording the draw queue
+  Render,
+  Count,
+};
+
+struct AllocationCount
+{
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+};
+
+// Counts allocations made through the global operator new while enabled; when
+// disabled the hook costs a single relaxed load. The phase is global, so
+// allocations of worker threads count towards the phase the main loop is in.
+class AllocationTracker
+{
+public:
+  static void set_enabled(bool enabled);
+  static bool is_enabled();
+  static void set_phase(AllocationPhase phase);
+  static AllocationPhase get_phase();
+  static AllocationCount get_count(AllocationPhase phase);
+  // Sum over all phases
+  static AllocationCount get_total();
+  static void reset();
+  static const char* get_phase_name(AllocationPhase phase);
+};
+
+// Sets the allocation phase for its lifetime
+class AllocationPhaseScope
+{
+  AllocationPhase previous_;
+public:
+  explicit AllocationPhaseScope(AllocationPhase phase)
+    : previous_(AllocationTracker::get_phase())
+  {
+    AllocationTracker::set_phase(phase);
+  }
+  AllocationPhaseScope(const AllocationPhaseScope&) = delete;
+  AllocationPhaseScope& operator=(const AllocationPhaseScope&) = delete;
+  ~AllocationPhaseScope() { AllocationTracker::set_phase(previous_); }
+};
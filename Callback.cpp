@@ -0,0 +1,38 @@
+#include "Callback.h"
+
+Callback::Callback(Callback&& other)
+{
+  if (other.call_)
+  {
+    other.manage_(Operation::Move, &other.storage_, &storage_);
+    call_ = other.call_;
+    manage_ = other.manage_;
+    other.call_ = nullptr;
+    other.manage_ = nullptr;
+  }
+}
+
+Callback& Callback::operator=(Callback&& other)
+{
+  if (this != &other)
+  {
+    reset();
+    if (other.call_)
+    {
+      other.manage_(Operation::Move, &other.storage_, &storage_);
+      call_ = other.call_;
+      manage_ = other.manage_;
+      other.call_ = nullptr;
+      other.manage_ = nullptr;
+    }
+  }
+  return *this;
+}
+
+void Callback::reset()
+{
+  if (call_)
+    manage_(Operation::Destroy, &storage_, nullptr);
+  call_ = nullptr;
+  manage_ = nullptr;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Callable taking no arguments, stored inline in a fixed buffer, so that
+// storing it needs no heap memory. Move only.
+class Callback
+{
+public:
+  static const size_t capacity = 48;
+private:
+  enum class Operation
+  {
+    Move,       // Moves from into to and destroys from
+    Destroy,
+  };
+
+  typename std::aligned_storage<capacity, alignof(std::max_align_t)>::type storage_;
+  void (*call_)(void* f) = nullptr;
+  void (*manage_)(Operation operation, void* from, void* to) = nullptr;
+
+  template<typename F>
+  static void call(void* f)
+  {
+    (*static_cast<F*>(f))();
+  }
+  template<typename F>
+  static void manage(Operation operation, void* from, void* to)
+  {
+    if (operation == Operation::Move)
+      new (to) F(std::move(*static_cast<F*>(from)));
+    static_cast<F*>(from)->~F();
+  }
+  void reset();
+public:
+  Callback() {}
+  template<typename F,
+    typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Callback>::value>::type>
+  Callback(F&& f)
+  {
+    typedef typename std::decay<F>::type type;
+    static_assert(sizeof(type) <= capacity, "Callback captures too much");
+    static_assert(alignof(type) <= alignof(std::max_align_t), "Callback is overaligned");
+    new (&storage_) type(std::forward<F>(f));
+    call_ = &call<type>;
+    manage_ = &manage<type>;
+  }
+  Callback(Callback&& other);
+  Callback& operator=(Callback&& other);
+  Callback(const Callback&) = delete;
+  Callback& operator=(const Callback&) = delete;
+  ~Callback() { reset(); }
+
+  void operator()() { call_(&storage_); }
+  explicit operator bool() const { return call_ != nullptr; }
+};
@@ -0,0 +1,658 @@
+//
+//  Headless backend for Engine.h: runs the act()/draw() loop without a window,
+//  renders into the offscreen buffer and feeds input from a script.
+//
+//  Build (Linux):
+//    g++ -std=c++14 -O2 -pthread EngineHeadless.cpp Allocations.cpp Callback.cpp Entities.cpp FrameArena.cpp Game.cpp Geometry.cpp Objects.cpp Particles.cpp Renderer.cpp JobSystem.cpp Scheduler.cpp SpatialGrid.cpp TaskGraph.cpp -o geometry-wars-headless
+//
+//  Usage:
+//    geometry-wars-headless [--frames N] [--dt SECONDS | --realtime] [--input FILE]
+//                           [--no-draw] [--dump FILE.ppm] [--threads N] [--pipeline]
+//                           [--alloc-stats] [--no-alloc-after FRAME] [--tick-rate HZ]
+//                           [--task-stats] [--seed S]
+//    geometry-wars-headless --batch GAMES [--seconds S] [--dt SECONDS] [--seed S] [--threads N]
+//                           [--tune NAME=VALUE]...
+//    geometry-wars-headless --bench-trig
+//
+//  --threads N runs the jobs of the game update and the renderer on N threads (0 - one per core),
+//             1 is serial.
+//  --pipeline rasterizes frame N in a job while frame N + 1 is simulated, in parallel given 2+ threads.
+//  --alloc-stats counts heap allocations per phase and reports them with the most in one frame.
+//  --no-alloc-after FRAME fails on the first frame from FRAME on that allocates (steady state check).
+//  --tick-rate HZ overrides the rate of the fixed ticks the game simulates in and draws between,
+//                0 runs one tick of the frame's dt per frame.
+//  --task-stats reports the average time of every task of a tick and of rendering.
+//  --seed S seeds the game, so that runs with the same script and dt draw the same frames
+//           whatever the thread count. Seeded from std::random_device otherwise.
+//  --batch GAMES plays independent games of S seconds (600 by default) without rendering,
+//               on N threads (one per core by default), and reports their totals. Game k is
+//               seeded with S + k (--seed, 1 by default) and played by a bot that fires at the
+//               nearest enemy, so the results do not depend on N.
+//  --tune NAME=VALUE sets a field of GameTuning for the batch, e.g. enemy_burst_size=30.
+//  --bench-trig times FastMath.h against libm, reports the errors and exits.
+//
+//  Input script: one event per line, '#' starts a comment.
+//    <frame> key <vk_code|LEFT|RIGHT|UP|DOWN|SPACE|ESCAPE|RETURN|char> down|up
+//    <frame> mouse <0|1> down|up
+//    <frame> cursor <x> <y>
+//    <frame> quit
+//  Events are applied before act() of the given frame and stay in effect until changed.
+//
+
+#ifndef _WIN32
+
+#include "Engine.h"
+#include "Game.h"
+#include "Allocations.h"
+#include "FastMath.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <random>
+
+uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] = { 0 };
+
+enum class InputType
+{
+  Key,
+  Mouse,
+  Cursor,
+  Quit,
+};
+
+struct InputEvent
+{
+  uint64_t frame = 0;
+  InputType type = InputType::Key;
+  int code = 0;
+  int x = 0;
+  int y = 0;
+  bool pressed = false;
+};
+
+static bool keys[256] = { false };
+static bool mouse_buttons[2] = { false };
+static int cursor_x = SCREEN_WIDTH / 2;
+static int cursor_y = 0;
+static bool quited = false;
+
+bool is_window_active()
+{
+  return true;
+}
+
+void clear_buffer()
+{
+  memset(buffer, 0, sizeof(buffer));
+}
+
+bool is_key_pressed(int button_vk_code)
+{
+  return button_vk_code >= 0 && button_vk_code < 256 && keys[button_vk_code];
+}
+
+bool is_mouse_button_pressed(int button)
+{
+  return button >= 0 && button < 2 && mouse_buttons[button];
+}
+
+int get_cursor_x()
+{
+  return cursor_x;
+}
+
+int get_cursor_y()
+{
+  return cursor_y;
+}
+
+void schedule_quit_game()
+{
+  quited = true;
+}
+
+static int parse_key(const std::string& name)
+{
+  if (name == "LEFT")
+    return VK_LEFT;
+  if (name == "RIGHT")
+    return VK_RIGHT;
+  if (name == "UP")
+    return VK_UP;
+  if (name == "DOWN")
+    return VK_DOWN;
+  if (name == "SPACE")
+    return VK_SPACE;
+  if (name == "ESCAPE")
+    return VK_ESCAPE;
+  if (name == "RETURN")
+    return VK_RETURN;
+  if (name.size() == 1 && !isdigit((unsigned char)name[0]))
+    return toupper((unsigned char)name[0]);
+
+  return atoi(name.c_str());
+}
+
+static bool load_script(const char* path, std::vector<InputEvent>& events)
+{
+  std::ifstream file(path);
+  if (!file)
+    return false;
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line))
+  {
+    ++line_number;
+    line = line.substr(0, line.find('#'));
+    std::istringstream in(line);
+    InputEvent event;
+    std::string command;
+    if (!(in >> event.frame >> command))
+      continue;
+
+    std::string state;
+    if (command == "key")
+    {
+      std::string key;
+      in >> key >> state;
+      event.type = InputType::Key;
+      event.code = parse_key(key);
+    }
+    else if (command == "mouse")
+    {
+      in >> event.code >> state;
+      event.type = InputType::Mouse;
+    }
+    else if (command == "cursor")
+    {
+      in >> event.x >> event.y;
+      event.type = InputType::Cursor;
+    }
+    else if (command == "quit")
+    {
+      event.type = InputType::Quit;
+    }
+    else
+    {
+      fprintf(stderr, "%s:%d: unknown command '%s'\n", path, line_number, command.c_str());
+      return false;
+    }
+    event.pressed = state == "down";
+    events.push_back(event);
+  }
+  std::stable_sort(events.begin(), events.end(),
+    [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+  return true;
+}
+
+static void apply_event(const InputEvent& event)
+{
+  switch (event.type)
+  {
+  case InputType::Key:
+    if (event.code >= 0 && event.code < 256)
+      keys[event.code] = event.pressed;
+    break;
+  case InputType::Mouse:
+    if (event.code >= 0 && event.code < 2)
+      mouse_buttons[event.code] = event.pressed;
+    break;
+  case InputType::Cursor:
+    cursor_x = event.x;
+    cursor_y = event.y;
+    break;
+  case InputType::Quit:
+    quited = true;
+    break;
+  }
+}
+
+static bool dump_buffer(const char* path)
+{
+  FILE* file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  fprintf(file, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+  std::vector<unsigned char> row(SCREEN_WIDTH * 3);
+  for (int y = 0; y < SCREEN_HEIGHT; ++y)
+  {
+    for (int x = 0; x < SCREEN_WIDTH; ++x)
+    {
+      uint32_t color = buffer[y][x];
+      row[3 * x] = (color >> 16) & 0xff;
+      row[3 * x + 1] = (color >> 8) & 0xff;
+      row[3 * x + 2] = color & 0xff;
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+  fclose(file);
+  return true;
+}
+
+// Times f over inputs in nanoseconds per call, sink keeps the results alive
+template<typename F>
+static double time_per_call(const std::vector<float>& inputs, F f, float& sink)
+{
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start = clock::now();
+  for (float input : inputs)
+    sink += f(input);
+  return std::chrono::duration<double, std::nano>(clock::now() - start).count() / inputs.size();
+}
+
+static void bench_trig()
+{
+  const size_t count = 1 << 22;
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> near_angles(-1000, 1000);
+  std::uniform_real_distribution<float> far_angles(-1e5f, 1e5f);
+  std::vector<float> angles(count), far(count), ratios(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    angles[i] = near_angles(gen);
+    far[i] = far_angles(gen);
+    ratios[i] = near_angles(gen);
+  }
+
+  double sin_cos_error = 0;
+  double far_error = 0;
+  double atan2_error = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    float s, c;
+    fast_sin_cos(angles[i], s, c);
+    sin_cos_error = std::max(sin_cos_error, std::max(fabs(s - sin(double(angles[i]))), fabs(c - cos(double(angles[i])))));
+    fast_sin_cos(far[i], s, c);
+    far_error = std::max(far_error, std::max(fabs(s - sin(double(far[i]))), fabs(c - cos(double(far[i])))));
+    // y and x in all quadrants
+    float x = i & 1 ? 1.0f : -1.0f;
+    float y = ratios[i];
+    atan2_error = std::max(atan2_error, fabs(fast_atan2(y, x) - atan2(double(y), double(x))));
+  }
+
+  float sink = 0;
+  double libm_sin_cos = time_per_call(angles, [](float a) { return std::sin(a) + std::cos(a); }, sink);
+  double fast = time_per_call(angles, [](float a) { float s, c; fast_sin_cos(a, s, c); return s + c; }, sink);
+  double libm_atan2 = time_per_call(ratios, [](float y) { return std::atan2(y, 1.0f - y); }, sink);
+  double fast_atan = time_per_call(ratios, [](float y) { return fast_atan2(y, 1.0f - y); }, sink);
+  printf("sin+cos  libm %.2f ns  fast %.2f ns  max error %.2g (|a| <= 1000), %.2g (|a| <= 1e5)\n",
+    libm_sin_cos, fast, sin_cos_error, far_error);
+  printf("atan2    libm %.2f ns  fast %.2f ns  max error %.2g\n", libm_atan2, fast_atan, atan2_error);
+  printf("(checksum %g)\n", sink);
+}
+
+static void print_task_stats(const char* graph, const TaskGraph& tasks)
+{
+  double runs = tasks.get_run_count() ? double(tasks.get_run_count()) : 1.0;
+  printf("%s tasks (%llu runs):\n", graph, (unsigned long long)tasks.get_run_count());
+  for (TaskGraph::Task task = 0; task < tasks.size(); ++task)
+    printf("  %-18s %.4f ms\n", tasks.get_name(task), tasks.get_total_time(task) * 1000 / runs);
+}
+
+// Fields of GameTuning by name, for --tune
+static const struct
+{
+  const char* name;
+  float GameTuning::* field;
+} tuning_fields[] =
+{
+  { "enemy_vel", &GameTuning::enemy_vel },
+  { "enemy_spawn_min_distance", &GameTuning::enemy_spawn_min_distance },
+  { "enemy_random_spawn_cooldown", &GameTuning::enemy_random_spawn_cooldown },
+  { "enemy_random_spawn_event_duration", &GameTuning::enemy_random_spawn_event_duration },
+  { "enemy_fast_spawn_cooldown", &GameTuning::enemy_fast_spawn_cooldown },
+  { "enemy_fast_spawn_duration", &GameTuning::enemy_fast_spawn_duration },
+  { "enemy_fast_spawn_event_duration", &GameTuning::enemy_fast_spawn_event_duration },
+  { "enemy_burst_cooldown", &GameTuning::enemy_burst_cooldown },
+  { "enemy_burst_size", &GameTuning::enemy_burst_size },
+  { "enemy_burst_rate", &GameTuning::enemy_burst_rate },
+  { "enemy_burst_event_duration", &GameTuning::enemy_burst_event_duration },
+};
+
+static bool parse_tuning(const std::string& assignment, GameTuning& tuning)
+{
+  size_t equals = assignment.find('=');
+  if (equals == std::string::npos)
+    return false;
+
+  std::string name = assignment.substr(0, equals);
+  for (const auto& entry : tuning_fields)
+  {
+    if (name == entry.name)
+    {
+      tuning.*entry.field = float(atof(assignment.c_str() + equals + 1));
+      return true;
+    }
+  }
+  return false;
+}
+
+// Player of the batch games: fires at the nearest enemy, backs away from it
+// when it comes close and otherwise returns to the centre
+static GameInput bot_input(const Game& game)
+{
+  const dim_t safe_distance = 250;
+  const dim_t dead_zone = 20;
+  Vector2d pos = game.get_player().get_position();
+  Vector2d centre = { SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 };
+  const EntityStore& enemies = game.get_enemies();
+  Vector2d target = pos;
+  dim_t nearest = -1;
+  for (uint32_t i = 0; i < enemies.size(); ++i)
+  {
+    dim_t distance = (enemies.pos[i] - pos).get_magnitude();
+    if (enemies.active[i] && (nearest < 0 || distance < nearest))
+    {
+      nearest = distance;
+      target = enemies.pos[i];
+    }
+  }
+
+  GameInput input;
+  input.cursor = nearest < 0 ? centre : target;
+  input.fire = nearest >= 0;
+  Vector2d move = nearest >= 0 && nearest < safe_distance ? pos - target : centre - pos;
+  input.left = move.x < -dead_zone;
+  input.right = move.x > dead_zone;
+  input.up = move.y < -dead_zone;
+  input.down = move.y > dead_zone;
+  return input;
+}
+
+// Plays game_count games of seconds each, in steps of dt, spread over the threads of jobs
+static void run_batch(uint64_t game_count, float seconds, float dt, uint32_t seed, const GameTuning& tuning)
+{
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start = clock::now();
+  // Games are the unit of work, every thread runs the tasks of its games by itself
+  std::vector<std::unique_ptr<JobSystem>> serial_jobs;
+  for (unsigned i = 0; i < jobs.get_thread_count(); ++i)
+    serial_jobs.emplace_back(new JobSystem());
+  std::vector<GameStats> results(game_count);
+  uint64_t steps = uint64_t(seconds / dt);
+  // At most as many jobs as a queue holds
+  size_t chunk = size_t(game_count / 1024 + 1);
+  jobs.parallel_for(size_t(game_count), chunk, [&](size_t begin, size_t end, unsigned worker)
+  {
+    for (size_t k = begin; k < end; ++k)
+    {
+      Game batch_game(*serial_jobs[worker], uint32_t(seed + k), tuning);
+      for (uint64_t step = 0; step < steps; ++step)
+      {
+        batch_game.set_input(bot_input(batch_game));
+        batch_game.advance(dt);
+      }
+      results[k] = batch_game.get_stats();
+    }
+  });
+  double wall = std::chrono::duration<double>(clock::now() - start).count();
+
+  GameStats total;
+  uint64_t best_score_sum = 0;
+  for (const GameStats& stats : results)
+  {
+    total.kills += stats.kills;
+    total.hits_taken += stats.hits_taken;
+    total.deaths += stats.deaths;
+    total.best_score = std::max(total.best_score, stats.best_score);
+    best_score_sum += stats.best_score;
+  }
+  double games = game_count ? double(game_count) : 1.0;
+  double minutes = games * steps * dt / 60;
+  printf("tuning:");
+  for (const auto& entry : tuning_fields)
+    printf(" %s=%g", entry.name, tuning.*entry.field);
+  printf("\n");
+  printf("games: %llu, %.0f s each, %u threads, %.3f s, %.0f simulated s/s\n",
+    (unsigned long long)game_count, steps * dt, jobs.get_thread_count(), wall, minutes * 60 / wall);
+  printf("per minute: kills %.3f, hits taken %.3f, deaths %.3f\n",
+    total.kills / minutes, total.hits_taken / minutes, total.deaths / minutes);
+  printf("best score: mean %.3f, max %u\n", best_score_sum / games, total.best_score);
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr,
+    "usage: %s [--frames N] [--dt SECONDS | --realtime] [--input FILE] [--no-draw] [--dump FILE.ppm]"
+    " [--threads N] [--pipeline] [--alloc-stats] [--no-alloc-after FRAME] [--tick-rate HZ]"
+    " [--task-stats] [--seed S]\n"
+    "       %s --batch GAMES [--seconds S] [--dt SECONDS] [--seed S] [--threads N] [--tune NAME=VALUE]...\n"
+    "       %s --bench-trig\n",
+    name, name, name);
+}
+
+int main(int argc, char* argv[])
+{
+  uint64_t frames = 600;
+  float fixed_dt = 1.0f / 60;
+  bool realtime = false;
+  bool render = true;
+  const char* input_path = nullptr;
+  const char* dump_path = nullptr;
+  unsigned threads = 1;
+  bool threads_given = false;
+  bool pipeline = false;
+  bool alloc_stats = false;
+  uint64_t no_alloc_after = UINT64_MAX;
+  float tick_rate = 0;
+  bool tick_rate_given = false;
+  bool task_stats = false;
+  uint64_t batch_games = 0;
+  float seconds = 600;
+  uint32_t seed = 1;
+  bool seed_given = false;
+  GameTuning tuning;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--frames" && has_value)
+      frames = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--dt" && has_value)
+      fixed_dt = float(atof(argv[++i]));
+    else if (arg == "--realtime")
+      realtime = true;
+    else if (arg == "--input" && has_value)
+      input_path = argv[++i];
+    else if (arg == "--no-draw")
+      render = false;
+    else if (arg == "--dump" && has_value)
+      dump_path = argv[++i];
+    else if (arg == "--threads" && has_value)
+    {
+      threads = unsigned(atoi(argv[++i]));
+      threads_given = true;
+    }
+    else if (arg == "--pipeline")
+      pipeline = true;
+    else if (arg == "--alloc-stats")
+      alloc_stats = true;
+    else if (arg == "--no-alloc-after" && has_value)
+      no_alloc_after = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--task-stats")
+      task_stats = true;
+    else if (arg == "--tick-rate" && has_value)
+    {
+      tick_rate = float(atof(argv[++i]));
+      tick_rate_given = true;
+    }
+    else if (arg == "--batch" && has_value)
+      batch_games = strtoull(argv[++i], nullptr, 10);
+    else if (arg == "--seconds" && has_value)
+      seconds = float(atof(argv[++i]));
+    else if (arg == "--seed" && has_value)
+    {
+      seed = uint32_t(strtoul(argv[++i], nullptr, 10));
+      seed_given = true;
+    }
+    else if (arg == "--tune" && has_value)
+    {
+      if (!parse_tuning(argv[++i], tuning))
+      {
+        fprintf(stderr, "unknown tuning '%s'\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (arg == "--bench-trig")
+    {
+      bench_trig();
+      return 0;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (batch_games)
+  {
+    jobs.set_thread_count(threads_given ? threads : 0);
+    run_batch(batch_games, seconds, fixed_dt, seed, tuning);
+    jobs.set_thread_count(1);
+    return 0;
+  }
+
+  std::vector<InputEvent> events;
+  if (input_path && !load_script(input_path, events))
+  {
+    fprintf(stderr, "failed to load input script '%s'\n", input_path);
+    return 1;
+  }
+
+  typedef std::chrono::steady_clock clock;
+  clock::duration act_time = clock::duration::zero();
+  clock::duration draw_time = clock::duration::zero();
+
+  initialize();
+  jobs.set_thread_count(threads);
+  render_pipeline.set_enabled(pipeline && render);
+  if (tick_rate_given)
+    game.set_tick_rate(tick_rate);
+  if (seed_given)
+    game.reseed(seed);
+  AllocationTracker::set_enabled(alloc_stats || no_alloc_after != UINT64_MAX);
+
+  size_t next_event = 0;
+  uint64_t frame = 0;
+  uint64_t max_frame_allocations = 0;
+  uint64_t max_allocations_frame = 0;
+  bool allocated_in_steady_state = false;
+  AllocationCount phase_counts[size_t(AllocationPhase::Count)];
+  clock::time_point ref_time = clock::now();
+  for (; frame < frames && !quited; ++frame)
+  {
+    while (next_event < events.size() && events[next_event].frame <= frame)
+      apply_event(events[next_event++]);
+
+    for (size_t phase = 0; phase < size_t(AllocationPhase::Count); ++phase)
+      phase_counts[phase] = AllocationTracker::get_count(AllocationPhase(phase));
+    uint64_t frame_start_allocations = AllocationTracker::get_total().allocations;
+
+    clock::time_point t = clock::now();
+    float dt = fixed_dt;
+    if (realtime)
+    {
+      dt = std::chrono::duration<float>(t - ref_time).count();
+      if (dt > 0.1f)
+        dt = 0.1f;
+    }
+    ref_time = t;
+
+    act(dt);
+    clock::time_point act_end = clock::now();
+    act_time += act_end - t;
+
+    if (render && !quited)
+    {
+      draw();
+      draw_time += clock::now() - act_end;
+    }
+
+    uint64_t frame_allocations = AllocationTracker::get_total().allocations - frame_start_allocations;
+    if (frame_allocations > max_frame_allocations)
+    {
+      max_frame_allocations = frame_allocations;
+      max_allocations_frame = frame;
+    }
+    if (frame >= no_alloc_after && frame_allocations > 0)
+    {
+      fprintf(stderr, "frame %llu allocated %llu times:", (unsigned long long)frame,
+        (unsigned long long)frame_allocations);
+      for (size_t phase = 0; phase < size_t(AllocationPhase::Count); ++phase)
+      {
+        uint64_t count = AllocationTracker::get_count(AllocationPhase(phase)).allocations
+          - phase_counts[phase].allocations;
+        if (count)
+          fprintf(stderr, " %s %llu", AllocationTracker::get_phase_name(AllocationPhase(phase)),
+            (unsigned long long)count);
+      }
+      fprintf(stderr, "\n");
+      allocated_in_steady_state = true;
+      break;
+    }
+  }
+  if (allocated_in_steady_state)
+    ++frame;
+  AllocationTracker::set_enabled(false);
+
+  finalize();
+
+  if (dump_path && !dump_buffer(dump_path))
+  {
+    fprintf(stderr, "failed to write '%s'\n", dump_path);
+    return 1;
+  }
+
+  typedef std::chrono::duration<double, std::milli> ms;
+  double act_ms = std::chrono::duration_cast<ms>(act_time).count();
+  double draw_ms = std::chrono::duration_cast<ms>(draw_time).count();
+  double n = frame ? double(frame) : 1.0;
+  printf("frames: %llu\n", (unsigned long long)frame);
+  printf("act:    %.3f ms total, %.4f ms/frame\n", act_ms, act_ms / n);
+  if (game.get_tick_rate() > 0)
+  {
+    uint64_t ticks = game.get_tick_count();
+    printf("ticks:  %llu, %.4f ms/tick\n", (unsigned long long)ticks, act_ms / (ticks ? ticks : 1));
+  }
+  printf("draw:   %.3f ms total, %.4f ms/frame\n", draw_ms, draw_ms / n);
+  CollisionStats collisions = game.get_collision_stats();
+  printf("collision tests: %llu, SAT: %llu, rejected by bounds: %llu\n",
+    (unsigned long long)collisions.tests, (unsigned long long)collisions.sat_tests,
+    (unsigned long long)(collisions.tests - collisions.sat_tests));
+  printf("projectile paths: %llu grid candidates, %llu rejected by bounds, %llu batch lanes, %llu swept tests\n",
+    (unsigned long long)collisions.grid_candidates, (unsigned long long)collisions.bounds_rejects,
+    (unsigned long long)collisions.batch_lanes, (unsigned long long)collisions.swept_tests);
+  if (task_stats)
+  {
+    print_task_stats("tick", game.get_tasks());
+    print_task_stats("render", renderer.get_tasks());
+  }
+  if (alloc_stats)
+  {
+    AllocationCount total = AllocationTracker::get_total();
+    printf("allocations: %llu, %llu bytes, at most %llu in frame %llu\n",
+      (unsigned long long)total.allocations, (unsigned long long)total.bytes,
+      (unsigned long long)max_frame_allocations, (unsigned long long)max_allocations_frame);
+    for (size_t phase = 0; phase < size_t(AllocationPhase::Count); ++phase)
+    {
+      AllocationCount count = AllocationTracker::get_count(AllocationPhase(phase));
+      printf("  %-8s %llu, %llu bytes\n", AllocationTracker::get_phase_name(AllocationPhase(phase)),
+        (unsigned long long)count.allocations, (unsigned long long)count.bytes);
+    }
+  }
+  return allocated_in_steady_state ? 2 : 0;
+}
+
+#endif
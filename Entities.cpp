@@ -0,0 +1,276 @@
+#include "Entities.h"
+#include <algorithm>
+#include <utility>
+
+const uint32_t EntityStore::npos;
+
+void EntityStore::move(uint32_t from, uint32_t to)
+{
+  slots_[to] = slots_[from];
+  slot_entity_[slots_[to]] = to;
+  pos[to] = pos[from];
+  vel[to] = vel[from];
+  angle[to] = angle[from];
+  rotate_speed[to] = rotate_speed[from];
+  vel_decay[to] = vel_decay[from];
+  health[to] = health[from];
+  damage[to] = damage[from];
+  color[to] = color[from];
+  active[to] = active[from];
+  model[to] = model[from];
+  vertices_[to] = vertices_[from];
+  bounds_min_[to] = bounds_min_[from];
+  bounds_max_[to] = bounds_max_[from];
+  transform_pos_[to] = transform_pos_[from];
+  transform_angle_[to] = transform_angle_[from];
+  transformed_[to] = transformed_[from];
+  // Swapped, so that the list of the entity moved over goes on to be reused
+  std::swap(hits[to], hits[from]);
+  prev_pos[to] = prev_pos[from];
+  prev_angle[to] = prev_angle[from];
+}
+
+void EntityStore::pop_back()
+{
+  slots_.pop_back();
+  pos.pop_back();
+  vel.pop_back();
+  angle.pop_back();
+  rotate_speed.pop_back();
+  vel_decay.pop_back();
+  health.pop_back();
+  damage.pop_back();
+  color.pop_back();
+  active.pop_back();
+  model.pop_back();
+  vertices_.pop_back();
+  bounds_min_.pop_back();
+  bounds_max_.pop_back();
+  transform_pos_.pop_back();
+  transform_angle_.pop_back();
+  transformed_.pop_back();
+  hits.back().clear();
+  spare_hits_.push_back(std::move(hits.back()));
+  hits.pop_back();
+  prev_pos.pop_back();
+  prev_angle.pop_back();
+}
+
+Handle EntityStore::add(const Vector2d& pos, const Vector2d& vel, health_t health, health_t damage,
+  const Polygon* model)
+{
+  uint32_t slot = free_head_;
+  if (slot == npos)
+  {
+    slot = uint32_t(slot_entity_.size());
+    slot_entity_.push_back(npos);
+    slot_generation_.push_back(1);
+    slot_next_free_.push_back(npos);
+  }
+  else
+  {
+    free_head_ = slot_next_free_[slot];
+    slot_next_free_[slot] = npos;
+  }
+
+  slot_entity_[slot] = size();
+  slots_.push_back(slot);
+  this->pos.push_back(pos);
+  this->vel.push_back(vel);
+  angle.push_back(0);
+  rotate_speed.push_back(0);
+  vel_decay.push_back(0);
+  this->health.push_back(health);
+  this->damage.push_back(damage);
+  color.push_back(COLOR::WHITE);
+  active.push_back(true);
+  this->model.push_back(model);
+  vertices_.emplace_back();
+  bounds_min_.push_back(pos);
+  bounds_max_.push_back(pos);
+  transform_pos_.push_back(pos);
+  transform_angle_.push_back(0);
+  transformed_.push_back(false);
+  if (spare_hits_.empty())
+  {
+    hits.emplace_back();
+  }
+  else
+  {
+    hits.push_back(std::move(spare_hits_.back()));
+    spare_hits_.pop_back();
+  }
+  prev_pos.push_back(pos);
+  prev_angle.push_back(0);
+  return { slot, slot_generation_[slot] };
+}
+
+void EntityStore::remove(const Handle& handle)
+{
+  if (!is_valid(handle))
+    return;
+
+  uint32_t i = slot_entity_[handle.index];
+  uint32_t last = size() - 1;
+  if (i != last)
+    move(last, i);
+  pop_back();
+
+  slot_entity_[handle.index] = npos;
+  ++slot_generation_[handle.index];
+  slot_next_free_[handle.index] = free_head_;
+  free_head_ = handle.index;
+}
+
+void EntityStore::remove_inactive()
+{
+  for (uint32_t i = 0; i < size();)
+  {
+    if (active[i])
+      ++i;
+    else
+      remove(get_handle(i));
+  }
+}
+
+void EntityStore::clear()
+{
+  while (size() > 0)
+    remove(get_handle(size() - 1));
+}
+
+void EntityStore::reserve(uint32_t count, size_t hit_count)
+{
+  slots_.reserve(count);
+  slot_entity_.reserve(count);
+  slot_generation_.reserve(count);
+  slot_next_free_.reserve(count);
+  pos.reserve(count);
+  vel.reserve(count);
+  angle.reserve(count);
+  rotate_speed.reserve(count);
+  vel_decay.reserve(count);
+  health.reserve(count);
+  damage.reserve(count);
+  color.reserve(count);
+  active.reserve(count);
+  model.reserve(count);
+  vertices_.reserve(count);
+  bounds_min_.reserve(count);
+  bounds_max_.reserve(count);
+  transform_pos_.reserve(count);
+  transform_angle_.reserve(count);
+  transformed_.reserve(count);
+  hits.reserve(count);
+  spare_hits_.reserve(count);
+  prev_pos.reserve(count);
+  prev_angle.reserve(count);
+  for (auto& list : hits)
+    list.reserve(hit_count);
+  for (auto& list : spare_hits_)
+    list.reserve(hit_count);
+  while (hits.size() + spare_hits_.size() < count)
+  {
+    spare_hits_.emplace_back();
+    spare_hits_.back().reserve(hit_count);
+  }
+}
+
+bool EntityStore::is_valid(const Handle& handle) const
+{
+  return handle.index < slot_entity_.size()
+    && slot_entity_[handle.index] != npos
+    && slot_generation_[handle.index] == handle.generation;
+}
+
+uint32_t EntityStore::get_index(const Handle& handle) const
+{
+  return is_valid(handle) ? slot_entity_[handle.index] : npos;
+}
+
+Handle EntityStore::get_handle(uint32_t i) const
+{
+  return { slots_[i], slot_generation_[slots_[i]] };
+}
+
+void EntityStore::update_transform(uint32_t i) const
+{
+  if (transformed_[i] && transform_pos_[i].x == pos[i].x && transform_pos_[i].y == pos[i].y
+    && transform_angle_[i] == angle[i])
+    return;
+
+  Geometry::transform(*model[i], pos[i], angle[i], vertices_[i], bounds_min_[i], bounds_max_[i]);
+  transform_pos_[i] = pos[i];
+  transform_angle_[i] = angle[i];
+  transformed_[i] = true;
+}
+
+const Polygon& EntityStore::get_vertices(uint32_t i) const
+{
+  update_transform(i);
+  return vertices_[i];
+}
+
+void EntityStore::get_bounds(uint32_t i, Vector2d& min, Vector2d& max) const
+{
+  update_transform(i);
+  min = bounds_min_[i];
+  max = bounds_max_[i];
+}
+
+void EntityStore::interpolate_vertices(uint32_t i, float t, Polygon& vertices) const
+{
+  Vector2d min, max;
+  Geometry::transform(*model[i], lerp(prev_pos[i], pos[i], t),
+    lerp_angle(prev_angle[i], angle[i], t), vertices, min, max);
+}
+
+void EntityStore::save_previous()
+{
+  prev_pos = pos;
+  prev_angle = angle;
+}
+
+void EntityStore::update_transforms(uint32_t begin, uint32_t end) const
+{
+  end = std::min(end, size());
+  for (uint32_t i = begin; i < end; ++i)
+    update_transform(i);
+}
+
+void EntityStore::integrate(float dt, uint32_t begin, uint32_t end)
+{
+  end = std::min(end, size());
+  for (uint32_t i = begin; i < end; ++i)
+  {
+    if (!active[i])
+      continue;
+
+    // World vertices follow when asked for
+    angle[i] += dt * rotate_speed[i];
+    pos[i] = { pos[i].x + dt * vel[i].x, pos[i].y + dt * vel[i].y };
+  }
+}
+
+void EntityStore::decay(float dt, uint32_t begin, uint32_t end)
+{
+  end = std::min(end, size());
+  for (uint32_t i = begin; i < end; ++i)
+  {
+    if (!active[i])
+      continue;
+
+    dim_t speed = vel[i].get_magnitude() - dt * vel_decay[i];
+    Vector2d norm = vel[i].get_normalized();
+    vel[i] = { norm.x * speed, norm.y * speed };
+  }
+}
+
+void EntityStore::deactivate_offscreen()
+{
+  for (uint32_t i = 0; i < size(); ++i)
+  {
+    if (active[i] && !BORDER_CHECK(pos[i].x, pos[i].y))
+      active[i] = false;
+  }
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "Engine.h"
+#include "Utility.h"
+#include "Geometry.h"
+#include "Objects.h"
+#include <cstdint>
+#include <vector>
+
+// Reference to an entity. The generation tells apart successive occupants of
+// the same slot, so a handle to a removed entity goes stale instead of
+// silently pointing at whatever was added in its place.
+struct Handle
+{
+  uint32_t index = UINT32_MAX;    // Slot, stable while the entity lives
+  uint32_t generation = 0;
+
+  bool operator==(const Handle& other) const
+  {
+    return index == other.index && generation == other.generation;
+  }
+  bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Entities of one kind stored as structure of arrays. Components are public
+// arrays indexed by entity [0, size()) and stay packed: remove() moves the last
+// entity into the hole. Handles go through a slot table, so they survive the
+// moves, and freed slots are reused last in, first out.
+// The systems below replace the virtual update of GameObject2d and run over
+// whole arrays or over a range [begin, end) of them, end clamped to size(); each
+// only touches active entities. Ranges that do not overlap may run on different
+// threads at once.
+class EntityStore
+{
+public:
+  static const uint32_t npos = UINT32_MAX;
+private:
+  std::vector<uint32_t> slots_ = {};              // Slot of every entity
+  std::vector<uint32_t> slot_entity_ = {};        // Entity of every slot, npos for free slots
+  std::vector<uint32_t> slot_generation_ = {};
+  std::vector<uint32_t> slot_next_free_ = {};
+  uint32_t free_head_ = npos;
+
+  // World vertices of model and their bounding box, valid while pos and angle
+  // stay those they were computed for
+  mutable std::vector<Polygon> vertices_ = {};
+  mutable std::vector<Vector2d> bounds_min_ = {};
+  mutable std::vector<Vector2d> bounds_max_ = {};
+  mutable std::vector<Vector2d> transform_pos_ = {};
+  mutable std::vector<float> transform_angle_ = {};
+  mutable std::vector<uint8_t> transformed_ = {};
+  std::vector<std::vector<Handle>> spare_hits_ = {};   // Emptied hit lists of removed entities, reused by add()
+
+  void move(uint32_t from, uint32_t to);
+  void pop_back();
+  void update_transform(uint32_t i) const;
+public:
+  std::vector<Vector2d> pos = {};
+  std::vector<Vector2d> vel = {};
+  std::vector<float> angle = {};
+  std::vector<float> rotate_speed = {};
+  std::vector<float> vel_decay = {};
+  std::vector<health_t> health = {};
+  std::vector<health_t> damage = {};
+  std::vector<uint32_t> color = {};
+  std::vector<uint8_t> active = {};
+  std::vector<const Polygon*> model = {};         // Outline in model space, shared, outlives the entity
+  std::vector<std::vector<Handle>> hits = {};     // Entities already hit, by projectiles
+  std::vector<Vector2d> prev_pos = {};            // Pose at the start of the tick, for drawing between ticks
+  std::vector<float> prev_angle = {};
+
+  // Active entity at pos with outline model, appended at index size() - 1
+  Handle add(const Vector2d& pos, const Vector2d& vel, health_t health, health_t damage,
+    const Polygon* model);
+  // Stale handles are ignored
+  void remove(const Handle& handle);
+  // Removes inactive entities like remove() does
+  void remove_inactive();
+  void clear();
+  // Room for count entities without allocating, and for hit_count hits of each
+  void reserve(uint32_t count, size_t hit_count = 0);
+
+  uint32_t size() const { return uint32_t(slots_.size()); }
+  bool is_valid(const Handle& handle) const;
+  // Entity index of handle, npos for stale handles
+  uint32_t get_index(const Handle& handle) const;
+  Handle get_handle(uint32_t i) const;
+  // Entity index of a live slot, as from Handle::index
+  uint32_t get_slot_entity(uint32_t slot) const { return slot_entity_[slot]; }
+
+  // World vertices and bounding box, computed on the first call after pos or angle changed.
+  // Not to be called from several threads unless update_transforms() ran since the change.
+  const Polygon& get_vertices(uint32_t i) const;
+  void get_bounds(uint32_t i, Vector2d& min, Vector2d& max) const;
+  // World vertices a fraction t of the way from the previous pose to the current one,
+  // not cached
+  void interpolate_vertices(uint32_t i, float t, Polygon& vertices) const;
+
+  // Makes the current poses the previous ones, at the start of a tick
+  void save_previous();
+
+  // Computes the world vertices of the entities that moved since, so that reading
+  // them no longer writes
+  void update_transforms(uint32_t begin = 0, uint32_t end = npos) const;
+
+  // Rotation by rotate_speed and movement by vel
+  void integrate(float dt, uint32_t begin = 0, uint32_t end = npos);
+  // Slows velocities down by vel_decay
+  void decay(float dt, uint32_t begin = 0, uint32_t end = npos);
+  // Deactivates entities whose position left the screen
+  void deactivate_offscreen();
+};
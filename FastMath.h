@@ -0,0 +1,59 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+
+// Float approximations of trigonometric functions, for placing vertices and
+// aiming, where a few units in the last place do not matter. Maximum absolute
+// errors against double precision libm, as measured by --bench-trig of the
+// headless backend:
+//   fast_sin_cos  1e-7 for |angle| <= 1000, 1e-6 for |angle| <= 1e5; the reduction
+//                 to [-pi/4, pi/4] loses precision beyond that, |angle| must stay
+//                 below 1e9 for the quadrant to fit an int
+//   fast_atan2    1.2e-5 radians, (0, 0) gives 0
+
+// sin and cos of angle with one range reduction
+inline void fast_sin_cos(float angle, float& sin, float& cos)
+{
+  // angle = q * pi/2 + r, pi/2 split in three parts so that q * part is exact
+  const float two_over_pi = 0.636619772f;
+  const float pio2_1 = 1.5703125f;
+  const float pio2_2 = 4.837512969970703125e-4f;
+  const float pio2_3 = 7.54978995489188216e-8f;
+  int quadrant = int(angle * two_over_pi + (angle < 0 ? -0.5f : 0.5f));
+  float q = float(quadrant);
+  float r = ((angle - q * pio2_1) - q * pio2_2) - q * pio2_3;
+
+  // Minimax polynomials on [-pi/4, pi/4]
+  float z = r * r;
+  float s = r + r * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+  float c = 1 - 0.5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f
+    + z * 2.443315711809948e-5f));
+
+  // Quadrants 1 and 3 swap sin and cos, sin is negative in 2 and 3, cos in 1 and 2.
+  // Selected without branches, the quadrant of an angle is hard to predict.
+  const float values[2] = { s, c };
+  int swap = quadrant & 1;
+  sin = values[swap] * float(1 - (quadrant & 2));
+  cos = values[swap ^ 1] * float(1 - ((quadrant + 1) & 2));
+}
+
+// Angle of (x, y) in [-pi, pi]
+inline float fast_atan2(float y, float x)
+{
+  const float pi = 3.14159265f;
+  float ax = std::fabs(x);
+  float ay = std::fabs(y);
+  float max = std::max(ax, ay);
+  if (max == 0)
+    return 0;
+
+  // atan on [0, 1], polynomial of Abramowitz and Stegun 4.4.49
+  float a = std::min(ax, ay) / max;
+  float s = a * a;
+  float r = a * (0.9998660f + s * (-0.3302995f + s * (0.1801410f + s * (-0.0851330f + s * 0.0208351f))));
+  if (ay > ax)
+    r = pi / 2 - r;
+  if (x < 0)
+    r = pi - r;
+  return y < 0 ? -r : r;
+}
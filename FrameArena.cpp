@@ -0,0 +1,36 @@
+#include "FrameArena.h"
+#include <stdexcept>
+
+FrameArena::FrameArena(size_t capacity)
+  : block_(new unsigned char[capacity]), capacity_(capacity)
+{}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+  if (alignment == 0 || (alignment & (alignment - 1)) || alignment > alignof(std::max_align_t))
+    throw std::invalid_argument("FrameArena alignment must be a power of two up to that of max_align_t");
+
+  // The block comes from new[], so offsets aligned here are aligned in memory
+  size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+  if (offset <= capacity_ && size <= capacity_ - offset)
+  {
+    used_ = offset + size;
+    return block_.get() + offset;
+  }
+
+  overflow_.emplace_back(new unsigned char[size ? size : 1]);
+  overflow_size_ += size + alignment;
+  return overflow_.back().get();
+}
+
+void FrameArena::reset()
+{
+  if (!overflow_.empty())
+  {
+    capacity_ = used_ + overflow_size_;
+    block_.reset(new unsigned char[capacity_]);
+    overflow_.clear();
+    overflow_size_ = 0;
+  }
+  used_ = 0;
+}
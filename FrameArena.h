@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that lives until the end of a frame: reset() at the
+// start of the next one releases everything at once. A frame needing more than
+// the capacity gets extra heap blocks, which the following reset() merges into
+// one block of the combined size, so frames of the same size stop allocating.
+// Only trivially destructible types, nothing is destroyed.
+class FrameArena
+{
+  std::unique_ptr<unsigned char[]> block_ = nullptr;
+  size_t capacity_ = 0;
+  size_t used_ = 0;
+  std::vector<std::unique_ptr<unsigned char[]>> overflow_ = {};
+  size_t overflow_size_ = 0;
+public:
+  explicit FrameArena(size_t capacity);
+  FrameArena(FrameArena&&) = default;
+  FrameArena& operator=(FrameArena&&) = default;
+
+  // Uninitialized memory, alignment must not exceed that of std::max_align_t
+  void* allocate(size_t size, size_t alignment);
+  // count default constructed objects
+  template<typename T>
+  T* allocate(size_t count)
+  {
+    static_assert(std::is_trivially_destructible<T>::value, "FrameArena does not destroy objects");
+    T* objects = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    for (size_t i = 0; i < count; ++i)
+      new (objects + i) T();
+    return objects;
+  }
+  void reset();
+
+  size_t get_capacity() const { return capacity_; }
+  // Bytes handed out since the last reset, including the overflow
+  size_t get_used() const { return used_ + overflow_size_; }
+};
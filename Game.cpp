@@ -3,8 +3,12 @@
 #include <memory.h>
 #include <algorithm>
 #include <random>
+#include <cmath>
+#include <stdexcept>
 #include "Geometry.h"
 #include "Game.h"
+#include "Allocations.h"
+#include "FastMath.h"
 //
 //  You are free to modify this file
 //
@@ -18,21 +22,50 @@
 //  is_window_active() - returns true if window is active
 //  schedule_quit_game() - quit game after act()
 
-std::random_device rd{};
-std::mt19937 gen{ rd() };
-std::normal_distribution<> normal_rnd{ 0, 2 };
-Game game = Game();
+JobSystem jobs;
+Game game(jobs, std::random_device{}());
+Renderer renderer(jobs);
+RenderPipeline render_pipeline(renderer, jobs);
+static RenderQueue render_queue;
+// Simulation ticks per second whatever the frame rate, frames draw between ticks
+static const float tick_rate = 60;
 
 // initialize game data in this function
 void initialize()
-{}
+{
+  game.set_tick_rate(tick_rate);
+  // Commands of a busy frame, so that recording does not allocate
+  render_queue.reserve(4096);
+  render_pipeline.reserve(4096);
+  renderer.reserve(4096);
+}
+
+// Controls as the engine reports them
+static GameInput read_input()
+{
+  GameInput input;
+  input.cursor = { dim_t(get_cursor_x()), dim_t(get_cursor_y()) };
+  input.left = is_key_pressed(VK_LEFT);
+  input.right = is_key_pressed(VK_RIGHT);
+  input.up = is_key_pressed(VK_UP);
+  input.down = is_key_pressed(VK_DOWN);
+  input.fire = is_mouse_button_pressed(0);
+  input.spawn = is_mouse_button_pressed(1);
+  return input;
+}
 
 // this function is called to update game data,
 // dt - time elapsed since the previous update (in seconds)
 void act(float dt)
 {
-  game.control(dt);
-  game.update(dt);
+  game.set_input(read_input());
+  game.advance(dt);
+  // the pipelined renderer takes its snapshot as soon as the frame is simulated
+  if (render_pipeline.is_enabled())
+  {
+    AllocationPhaseScope phase(AllocationPhase::Record);
+    game.draw(render_pipeline.get_record_queue());
+  }
   if (is_key_pressed(VK_ESCAPE))
     schedule_quit_game();
 }
@@ -41,253 +74,583 @@ void act(float dt)
 // uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] - is an array of 32-bit colors (8 bits per R, G, B)
 void draw()
 {
-  // clear backbuffer
-  memset(buffer, 0, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
+  if (render_pipeline.is_enabled())
+  {
+    AllocationPhaseScope phase(AllocationPhase::Render);
+    render_pipeline.present(buffer);
+    return;
+  }
+
+  {
+    AllocationPhaseScope phase(AllocationPhase::Record);
+    render_queue.clear();
+    game.draw(render_queue);
+  }
+  AllocationPhaseScope phase(AllocationPhase::Render);
+  // clears what the previous frame drew, then rasterizes the queue
   //Geometry::draw_circle(buffer, { SCREEN_HEIGHT/2, SCREEN_WIDTH/2 }, 100, COLOR::WHITE);
   //Geometry::draw_line(buffer, { 10, 10 }, { 1000, 100 }, COLOR::WHITE);
   //Geometry::draw_triangle(buffer, { 100, 100 }, 100, 45, COLOR::WHITE);
-  game.draw(buffer);
+  renderer.render(render_queue, buffer);
 }
 
 // free game data in this function
 void finalize()
-{}
+{
+  render_pipeline.set_enabled(false);
+  jobs.set_thread_count(1);
+}
 
 void Game::control(float dt)
 {
-  static bool mouse_rbutton_pressed = false;
-
   if (player_.is_dead())
     return;
 
-  if (is_key_pressed(VK_LEFT))
+  if (input_.left)
     player_.set_velocity({ -player_vel_, player_.get_velocity().y });
 
-  if (is_key_pressed(VK_RIGHT))
+  if (input_.right)
     player_.set_velocity({ player_vel_, player_.get_velocity().y });
 
-  if (is_key_pressed(VK_UP))
+  if (input_.up)
     player_.set_velocity({ player_.get_velocity().x, -player_vel_ });
 
-  if (is_key_pressed(VK_DOWN))
+  if (input_.down)
     player_.set_velocity({ player_.get_velocity().x, player_vel_ });
 
-  if (is_mouse_button_pressed(1) & !mouse_rbutton_pressed)
+  if (input_.spawn & !spawn_pressed_)
   {
-    Vector2d pos = { dim_t(get_cursor_x()), dim_t(get_cursor_y()) };
-    //spawn_enemy(pos);
-    mouse_rbutton_pressed = true;
+    //spawn_enemy(input_.cursor);
+    spawn_pressed_ = true;
   }
 
-  if (!is_mouse_button_pressed(1))
+  if (!input_.spawn)
   {
-    mouse_rbutton_pressed = false;
+    spawn_pressed_ = false;
   }
 
-  if (is_mouse_button_pressed(0) & !player_shoot_cooldown_acc_)
+  if (input_.fire & !player_shoot_cooldown_acc_)
   {
     player_shoot_cooldown_acc_ = player_shoot_cooldown_;
     shoot();
   }
 
   Vector2d player_pos = player_.get_position();
-  Vector2d direction = { get_cursor_x() - player_pos.x , get_cursor_y() - player_pos.y };
-  float angle = -atan(direction.x / direction.y);
-  player_.rotate(player_pos, -player_.get_angle());
-  player_.rotate(player_pos, direction.y < 0 ? angle : PI + angle);
+  Vector2d direction = input_.cursor - player_pos;
+  // The player points up, along -y, at angle 0
+  player_.set_angle(fast_atan2(direction.x, -direction.y));
+}
+
+// Square of half-size size around the origin
+static Polygon make_square(dim_t size)
+{
+  Polygon square;
+  square.push_back({ -size, -size });
+  square.push_back({ size, -size });
+  square.push_back({ size, size });
+  square.push_back({ -size, size });
+  return square;
 }
 
-Game::Game()
-  : player_(player_init_pos_, player_init_vel_, player_health_),
-  score_(score_pos_, score_size_)
+Game::Game(JobSystem& jobs, uint32_t seed, const GameTuning& tuning)
+  : tuning_(tuning),
+  gen_(seed),
+  enemy_shape_(std::make_shared<Shape>(make_square(enemy_size_))),
+  projectile_shape_(std::make_shared<Shape>(make_square(projectile_size_))),
+  player_(player_init_pos_, player_init_vel_, player_health_),
+  score_(score_pos_, score_size_),
+  jobs_(jobs)
 {
   player_.set_vel_decay(player_vel_decay_);
+  // A projectile may go through a whole burst at once
+  projectile_hit_reserve_ = size_t(tuning_.enemy_burst_size) + 4;
+  enemies_.reserve(enemy_reserve_);
+  projectiles_.reserve(projectile_reserve_, projectile_hit_reserve_);
+  scheduler_.reserve(timer_reserve_);
+  enemy_grid_.reserve(enemy_reserve_);
+  collision_candidates_.reserve(candidate_reserve_);
+  reserve_scratch(jobs_.get_thread_count());
+
+  // A tick, tasks that do not depend on each other may run in parallel
+  typedef TaskGraph::Task Task;
+  Task input = tasks_.add("input", [this]()
+  {
+    AllocationPhaseScope phase(AllocationPhase::Control);
+    control(tick_dt_);
+  });
+  Task player = tasks_.add("player", [this]()
+  {
+    player_.update(tick_dt_);
+    if (player_shoot_cooldown_acc_ - tick_dt_ > 0)
+      player_shoot_cooldown_acc_ -= tick_dt_;
+    else
+      player_shoot_cooldown_acc_ = 0;
+  }, { input });
+  Task events = tasks_.add("events", [this]()
+  {
+    update_event(tick_dt_);
+    scheduler_.advance(tick_dt_);
+  }, { player });
+  Task enemy_grid = tasks_.add("enemy grid", [this]() { build_enemy_grid(); }, { events });
+  Task projectiles = tasks_.add("projectiles", [this]() { move_projectiles(tick_dt_); }, { events });
+  Task collision = tasks_.add("collision", [this]() { detect_collisions(); }, { enemy_grid, projectiles });
+  Task hits = tasks_.add("hits", [this]() { resolve_hits(); }, { collision });
+  Task enemies = tasks_.add("enemies", [this]() { update_enemies(tick_dt_); }, { hits });
+  Task player_collision = tasks_.add("player collision", [this]() { collide_player(); }, { enemies });
+  tasks_.add("particles", [this]() { update_particles(tick_dt_); }, { player_collision });
 }
 
-void Game::draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const
+void Game::reserve_scratch(unsigned thread_count)
 {
-  if (player_.is_active())
-    player_.draw(buffer);
+  collision_scratch_.resize(thread_count);
+  for (auto& scratch : collision_scratch_)
+  {
+    scratch.candidates.reserve(candidate_reserve_);
+    scratch.quads.reserve(enemy_reserve_);
+    scratch.hits.reserve(enemy_reserve_);
+  }
+  // Chunks of as many projectiles as reserved
+  size_t chunk_count = JobSystem::get_chunk_count(projectile_reserve_, projectile_chunk_);
+  if (chunk_hits_.size() < chunk_count)
+    chunk_hits_.resize(chunk_count);
+  for (auto& hits : chunk_hits_)
+    hits.reserve(projectile_chunk_ * projectile_hit_reserve_);
+}
+
+void Game::advance(float dt)
+{
+  if (tick_rate_ <= 0)
+  {
+    tick(dt);
+    return;
+  }
+
+  float step = 1 / tick_rate_;
+  tick_accumulator_ += dt;
+  for (unsigned ticks = 0; ticks < max_ticks_ && tick_accumulator_ >= step; ++ticks)
+  {
+    tick(step);
+    tick_accumulator_ -= step;
+  }
+  // Too far behind, e.g. after a stall: the simulation slows down instead of catching up
+  if (tick_accumulator_ >= step)
+    tick_accumulator_ = std::fmod(tick_accumulator_, step);
+  interpolation_ = tick_accumulator_ / step;
+}
+
+void Game::tick(float dt)
+{
+  frame_arena_.reset();
+  player_.save_previous();
+  projectiles_.save_previous();
+  enemies_.save_previous();
+  tick_dt_ = dt;
+  AllocationPhaseScope phase(AllocationPhase::Update);
+  tasks_.run(jobs_);
+  ++tick_count_;
+}
+
+void Game::reseed(uint32_t seed)
+{
+  gen_.seed(seed);
+  normal_rnd_.reset();
+}
+
+void Game::set_tick_rate(float rate)
+{
+  if (!(rate >= 0))
+    throw std::invalid_argument("Tick rate must not be negative");
+
+  tick_rate_ = rate;
+  tick_accumulator_ = 0;
+  interpolation_ = 1;
+}
 
-  score_.draw(buffer);
-  for (const auto& enemy : enemies_)
+void Game::draw(RenderQueue& queue) const
+{
+  // Between ticks moving objects are drawn where they were a fraction t of the way
+  float t = interpolation_;
+  Polygon vertices;
+  if (player_.is_active())
   {
-    if (enemy.is_active())
-      enemy.draw(buffer);
+    if (t < 1)
+    {
+      player_.interpolate_vertices(t, vertices);
+      queue.add_outline(vertices, player_.get_color());
+    }
+    else
+    {
+      player_.draw(queue);
+    }
   }
-  for (const auto& projectile : projectiles_)
+
+  score_.draw(queue);
+  for (uint32_t i = 0; i < enemies_.size(); ++i)
   {
-    if (projectile.is_active())
-      projectile.draw(buffer);
+    if (!enemies_.active[i])
+      continue;
+
+    if (t < 1)
+    {
+      enemies_.interpolate_vertices(i, t, vertices);
+      queue.add_outline(vertices, enemies_.color[i]);
+    }
+    else
+    {
+      queue.add_outline(enemies_.get_vertices(i), enemies_.color[i]);
+    }
   }
-  for (const auto& particle : particles_)
+  for (uint32_t i = 0; i < projectiles_.size(); ++i)
   {
-    if (particle.is_active())
-      particle.draw(buffer);
+    if (projectiles_.active[i])
+    {
+      Vector2d pos = t < 1 ? lerp(projectiles_.prev_pos[i], projectiles_.pos[i], t) : projectiles_.pos[i];
+      queue.add_circle(pos, projectile_size_, projectiles_.color[i]);
+    }
   }
+  particles_.draw(queue, t < 1 ? (1 - t) / tick_rate_ : 0);
   for (int i = 0; i < player_.get_health(); i++)
   {
-    Geometry::draw_fill_rectangle(buffer, { dim_t(20 + 1.2 * i * health_size), 20 },
+    queue.add_fill_rectangle({ dim_t(20 + 1.2 * i * health_size), 20 },
       health_size, health_size, COLOR::RED);
   }
 }
 
-void Game::update(float dt)
+void Game::move_projectiles(float dt)
 {
-  player_.update(dt);
-  update_event(dt);
+  // Collisions of a projectile depend only on its own path, so all of them move first
+  uint32_t projectile_count = projectiles_.size();
+  ProjectilePath* paths = frame_arena_.allocate<ProjectilePath>(projectile_count);
+  jobs_.parallel_for(projectile_count, entity_chunk_, [this, paths, dt](size_t begin, size_t end, unsigned)
+  {
+    projectiles_.update_transforms(uint32_t(begin), uint32_t(end));
+    for (size_t i = begin; i < end; ++i)
+    {
+      paths[i].from = projectiles_.pos[i];
+      projectiles_.get_bounds(uint32_t(i), paths[i].min, paths[i].max);
+    }
+    projectiles_.integrate(dt, uint32_t(begin), uint32_t(end));
+    projectiles_.decay(dt, uint32_t(begin), uint32_t(end));
+    projectiles_.update_transforms(uint32_t(begin), uint32_t(end));
+  });
+  paths_ = paths;
+}
 
-  for (auto& projectile : projectiles_)
+void Game::detect_collisions()
+{
+  if (collision_scratch_.size() < jobs_.get_thread_count())
+    reserve_scratch(jobs_.get_thread_count());
+  uint32_t projectile_count = projectiles_.size();
+  size_t chunk_count = JobSystem::get_chunk_count(projectile_count, projectile_chunk_);
+  if (chunk_hits_.size() < chunk_count)
+    chunk_hits_.resize(chunk_count);
+  jobs_.parallel_for(projectile_count, projectile_chunk_, [this](size_t begin, size_t end, unsigned worker)
+  {
+    std::vector<Handle>& hits = chunk_hits_[begin / projectile_chunk_];
+    hits.clear();
+    detect_hits(paths_, uint32_t(begin), uint32_t(end), collision_scratch_[worker], hits);
+  });
+  for (CollisionScratch& scratch : collision_scratch_)
   {
-    if (projectile.is_active())
+    collision_stats_.grid_candidates += scratch.stats.grid_candidates;
+    collision_stats_.bounds_rejects += scratch.stats.bounds_rejects;
+    collision_stats_.batch_lanes += scratch.stats.batch_lanes;
+    collision_stats_.swept_tests += scratch.stats.swept_tests;
+    scratch.stats = CollisionStats();
+  }
+}
+
+void Game::resolve_hits()
+{
+  // Hits are applied in projectile order. An enemy killed by an earlier
+  // projectile is not hit by the later ones.
+  ProjectilePath* paths = paths_;
+  for (uint32_t p = 0; p < projectiles_.size();)
+  {
+    const ProjectilePath& path = paths[p];
+    const std::vector<Handle>& hits = chunk_hits_[path.chunk];
+    for (uint32_t k = path.first_hit; k < path.first_hit + path.hit_count; ++k)
     {
-      projectile.update(dt);
-      std::for_each(enemies_.begin(), enemies_.end(),
-        [&](Enemy& enemy)
+      // Handles go stale if the enemy was removed since detection
+      const Handle& handle = hits[k];
+      uint32_t e = enemies_.get_index(handle);
+      if (e == EntityStore::npos || !enemies_.active[e] || enemies_.health[e] <= 0)
+        continue;
+
+      enemies_.health[e] -= projectiles_.damage[p];
+      enemies_.color[e] = COLOR::RED;
+      schedule(enemies_, handle, 0.1, [this](uint32_t i) { enemies_.color[i] = COLOR::WHITE; });
+      projectiles_.health[p] -= enemies_.damage[e];
+      projectiles_.hits[p].push_back(handle);
+
+      if (enemies_.health[e] <= 0)
       {
-        if (enemy.is_active()
-          && !enemy.is_dead()
-          && !projectile.is_enemy_affected(enemy)
-          && projectile.is_intersect(enemy))
-        {
-          enemy.set_health(enemy.get_health() - projectile.get_damage());
-          enemy.set_color(COLOR::RED);
-          enemy.add_effect(0.1, [&]() { enemy.set_color(COLOR::WHITE); });
-          projectile.set_health(projectile.get_health() - enemy.get_damage());
-          projectile.add_affected_enemy(enemy);
-
-          if (enemy.is_dead())
-          {
-            enemy.set_active(false);
-            score_.set_score(score_.get_score() + 1);
-            destroy_object(enemy, 1);
-          }
-        }
-      });
+        enemies_.active[e] = false;
+        score_.set_score(score_.get_score() + 1);
+        ++stats_.kills;
+        stats_.best_score = std::max(stats_.best_score, score_.get_score());
+        destroy_object(*enemy_shape_, enemies_.pos[e], enemies_.angle[e], enemies_.vel[e],
+          enemies_.rotate_speed[e], 1);
+      }
+    }
+
+    if (!BORDER_CHECK(projectiles_.pos[p].x, projectiles_.pos[p].y) || projectiles_.health[p] <= 0)
+      projectiles_.active[p] = false;
+    if (projectiles_.active[p])
+    {
+      ++p;
+    }
+    else
+    {
+      // remove() moves the last projectile into p, its path goes along
+      paths[p] = paths[projectiles_.size() - 1];
+      projectiles_.remove(projectiles_.get_handle(p));
     }
-    if (projectile.is_dead())
-      projectile.set_active(false);
   }
+}
 
-  for (auto& enemy : enemies_)
+void Game::update_enemies(float dt)
+{
+  // Enemies killed by projectiles are inactive and skipped by the systems
+  jobs_.parallel_for(enemies_.size(), entity_chunk_, [this, dt](size_t begin, size_t end, unsigned)
   {
-    if (enemy.is_active())
+    enemies_.integrate(dt, uint32_t(begin), uint32_t(end));
+    enemies_.decay(dt, uint32_t(begin), uint32_t(end));
+  });
+  enemies_.deactivate_offscreen();
+  enemies_.remove_inactive();
+  build_enemy_grid();
+}
+
+void Game::collide_player()
+{
+  // Enemies are tested against the player after all of them moved, in slot order
+  Vector2d player_min, player_max;
+  player_.get_bounds(player_min, player_max);
+  collision_candidates_.clear();
+  enemy_grid_.query(player_min, player_max, collision_candidates_);
+  for (uint32_t slot : collision_candidates_)
+  {
+    uint32_t e = enemies_.get_slot_entity(slot);
+    Vector2d enemy_min, enemy_max;
+    enemies_.get_bounds(e, enemy_min, enemy_max);
+    if (player_.is_active()
+      && player_.is_damageable()
+      && Object2d::is_intersect(player_.get_vertices(), player_min, player_max,
+        enemies_.get_vertices(e), enemy_min, enemy_max))
     {
-      enemy.update(dt);
-      if (player_.is_active()
-        && player_.is_damageable()
-        && player_.is_intersect(enemy))
+      player_.set_health(player_.get_health() - enemies_.damage[e]);
+      ++stats_.hits_taken;
+      player_.set_god_mode(true);
+      player_.set_color(COLOR::RED);
+      scheduler_.schedule(0.5, [this]() { player_.set_color(COLOR::WHITE); });
+      scheduler_.schedule(0.5, [this]() { player_.set_god_mode(false); });
+      if (player_.is_dead())
       {
-        player_.set_health(player_.get_health() - enemy.get_damage());
-        player_.set_god_mode(true);
-        player_.set_color(COLOR::RED);
-        player_.add_effect(0.5, [&]() { player_.set_color(COLOR::WHITE); });
-        player_.add_effect(0.5, [&]() { player_.set_god_mode(false); });
-        if (player_.is_dead())
-        {
-          player_.set_velocity(player_.get_velocity().get_normalized() * 10);
-          destroy_object(player_, 5);
-          player_.set_active(false);
-          player_.add_effect(5, [&]() { game.reset(); });;
-        }
+        player_.set_velocity(player_.get_velocity().get_normalized() * 10);
+        destroy_object(*player_.get_shape(), player_.get_position(), player_.get_angle(),
+          player_.get_velocity(), player_.get_rotate_speed(), 5);
+        player_.set_active(false);
+        ++stats_.deaths;
+        scheduler_.schedule(5, [this]() { reset(); });
       }
     }
   }
+}
+
+void Game::update_particles(float dt)
+{
+  jobs_.parallel_for(particles_.size(), particle_chunk_, [this, dt](size_t begin, size_t end, unsigned)
+  {
+    particles_.integrate(dt, begin, end);
+  });
+  particles_.remove_expired();
+}
+
+void Game::build_enemy_grid()
+{
+  // Transforms are computed up front, the parallel phases only read them
+  jobs_.parallel_for(enemies_.size(), entity_chunk_, [this](size_t begin, size_t end, unsigned)
+  {
+    enemies_.update_transforms(uint32_t(begin), uint32_t(end));
+  });
 
-  for (auto& particle : particles_)
+  // Enemies are keyed by slot in the grid, slots stay put when entities move
+  enemy_grid_.clear();
+  for (uint32_t i = 0; i < enemies_.size(); ++i)
   {
-    particle.update(dt);
+    if (enemies_.active[i])
+    {
+      Vector2d min, max;
+      enemies_.get_bounds(i, min, max);
+      enemy_grid_.insert(enemies_.get_handle(i).index, min, max);
+    }
   }
+  enemy_grid_.build();
+}
 
-  auto dead_particle_start = std::remove_if(particles_.begin(), particles_.end(),
-    [](const GameObject2d& particle) { return !particle.is_active(); });
+void Game::detect_hits(ProjectilePath* paths, uint32_t begin, uint32_t end,
+  CollisionScratch& scratch, std::vector<Handle>& hits) const
+{
+  // Counted locally and added to the scratch counters once
+  uint64_t grid_candidates = 0;
+  uint64_t batch_lanes = 0;
+  uint64_t swept_tests = 0;
+  for (uint32_t p = begin; p < end; ++p)
+  {
+    ProjectilePath& path = paths[p];
+    path.chunk = uint32_t(begin / projectile_chunk_);
+    path.first_hit = uint32_t(hits.size());
+
+    // Enemies along the whole path of this step are candidates
+    Vector2d min, max;
+    projectiles_.get_bounds(p, min, max);
+    min = { std::min(min.x, path.min.x), std::min(min.y, path.min.y) };
+    max = { std::max(max.x, path.max.x), std::max(max.y, path.max.y) };
+    scratch.candidates.clear();
+    enemy_grid_.query(min, max, scratch.candidates);
+    grid_candidates += scratch.candidates.size();
+
+    // The box covers the projectile at both ends, so it also covers the swept circle,
+    // enemies outside of it are missed by both tests below
+    size_t kept = 0;
+    scratch.quads.clear();
+    for (uint32_t slot : scratch.candidates)
+    {
+      uint32_t e = enemies_.get_slot_entity(slot);
+      Vector2d enemy_min, enemy_max;
+      enemies_.get_bounds(e, enemy_min, enemy_max);
+      if (enemy_min.x > max.x || enemy_max.x < min.x || enemy_min.y > max.y || enemy_max.y < min.y)
+        continue;
+      scratch.candidates[kept++] = slot;
+      scratch.quads.push_back(enemies_.get_vertices(e));
+    }
+    scratch.candidates.resize(kept);
+    scratch.hits.resize(kept);
+    Geometry::intersect_batch(projectiles_.get_vertices(p), scratch.quads, scratch.hits.data());
+    batch_lanes += kept;
+
+    const std::vector<Handle>& hit_before = projectiles_.hits[p];
+    for (size_t k = 0; k < kept; ++k)
+    {
+      uint32_t e = enemies_.get_slot_entity(scratch.candidates[k]);
+      Handle handle = enemies_.get_handle(e);
+      if (std::find(hit_before.begin(), hit_before.end(), handle) != hit_before.end())
+        continue;
+      if (!scratch.hits[k])
+      {
+        ++swept_tests;
+        if (!is_swept_intersect(path.from, p, e))
+          continue;
+      }
+      hits.push_back(handle);
+    }
+    path.hit_count = uint32_t(hits.size()) - path.first_hit;
+  }
+  scratch.stats.grid_candidates += grid_candidates;
+  scratch.stats.bounds_rejects += grid_candidates - batch_lanes;
+  scratch.stats.batch_lanes += batch_lanes;
+  scratch.stats.swept_tests += swept_tests;
+}
 
-  particles_.erase(dead_particle_start, particles_.end());
+CollisionStats Game::get_collision_stats() const
+{
+  CollisionStats stats = collision_stats_;
+  CollisionStats objects = Object2d::get_collision_stats();
+  stats.tests = objects.tests;
+  stats.sat_tests = objects.sat_tests;
+  return stats;
+}
 
-  if (player_shoot_cooldown_acc_ - dt > 0)
-    player_shoot_cooldown_acc_ -= dt;
-  else
-    player_shoot_cooldown_acc_ = 0;
+bool Game::is_swept_intersect(const Vector2d& from, uint32_t projectile, uint32_t enemy) const
+{
+  Vector2d to = projectiles_.pos[projectile];
+  Vector2d min, max;
+  enemies_.get_bounds(enemy, min, max);
+  dim_t r = projectile_size_;
+  if (std::min(from.x, to.x) - r > max.x || std::max(from.x, to.x) + r < min.x
+    || std::min(from.y, to.y) - r > max.y || std::max(from.y, to.y) + r < min.y)
+    return false;
+
+  return Geometry::is_swept_circle_intersect(enemies_.get_vertices(enemy), from, to, r);
 }
 
 void Game::shoot()
 {
   Vector2d player_pos = player_.get_position();
-  Vector2d direction = { get_cursor_x() - player_pos.x , get_cursor_y() - player_pos.y };
+  Vector2d direction = input_.cursor - player_pos;
   Vector2d vel = direction.get_normalized() * projectile_vel_;
-  Projectile& projectile = spawn_object<Projectile>(projectiles_, player_pos, vel,
-    projectile_health_, projectile_damage_, true);
+  spawn_object(projectiles_, *projectile_shape_, player_pos, vel, projectile_health_, projectile_damage_);
 }
 
 void Game::reset()
 {
-  for (auto& projectile : projectiles_)
-  {
-    projectile.set_active(false);
-  }
-  for (auto& enemy : enemies_)
-  {
-    enemy.set_active(false);
-  }
+  // Pending effects belong to the round that ended
+  scheduler_.clear();
+  projectiles_.clear();
+  enemies_.clear();
   player_.set_health(player_health_);
-  player_.rotate(player_.get_position(), -player_.get_angle());
+  player_.set_angle(0);
   player_.set_position(player_init_pos_);
   player_.set_velocity(player_init_vel_);
   player_.set_active(true);
+  player_.save_previous();
   score_.set_score(0);
   event_ = Event::RandomSpawnEnemiesTargetPlayer;
   event_time_ = 0;
 }
 
+Handle Game::spawn_object(EntityStore& store, const Shape& shape, const Vector2d& pos, const Vector2d& vel,
+  health_t health, health_t damage)
+{
+  return store.add(pos, vel, health, damage, &shape.get_outline());
+}
+
 void Game::spawn_enemy(const Vector2d& pos)
 {
-  Enemy& object = spawn_object<Enemy>(enemies_, pos, { 0, 0 }, enemy_health_, enemy_damage_, true);
+  Handle handle = spawn_object(enemies_, *enemy_shape_, pos, { 0, 0 }, enemy_health_, enemy_damage_);
+  uint32_t i = enemies_.get_index(handle);
   float rotate_dir = (player_.get_position().x < pos.x) ? -1 : 1;
-  object.set_rotate_speed(5 * rotate_dir);
-  object.add_effect(1, [&, rotate_dir]() { object.set_rotate_speed(10 * rotate_dir); });
-  object.add_effect(2, [&, rotate_dir]() { object.set_rotate_speed(15 * rotate_dir); });
-  object.add_effect(3, [&, rotate_dir]() { object.set_rotate_speed(20 * rotate_dir); });
-  object.add_effect(3,
-    [&]()
+  enemies_.rotate_speed[i] = 5 * rotate_dir;
+  schedule(enemies_, handle, 1,
+    [this, rotate_dir](uint32_t i) { enemies_.rotate_speed[i] = 10 * rotate_dir; });
+  schedule(enemies_, handle, 2,
+    [this, rotate_dir](uint32_t i) { enemies_.rotate_speed[i] = 15 * rotate_dir; });
+  schedule(enemies_, handle, 3,
+    [this, rotate_dir](uint32_t i) { enemies_.rotate_speed[i] = 20 * rotate_dir; });
+  schedule(enemies_, handle, 3,
+    [this](uint32_t i)
   {
     Vector2d player_pos = player_.get_position();
     //Vector2d player_vel = player_.get_velocity();
-    Vector2d enemy_pos = object.get_position();
+    Vector2d enemy_pos = enemies_.pos[i];
     Vector2d direction = player_pos - enemy_pos;
     //float travel_time = direction.get_magnitude() / enemy_vel_;
-    float random = normal_rnd(gen) * 50;
+    float random = normal_rnd_(gen_) * 50;
     Vector2d variation = direction.get_norm().get_normalized() * random;
     Vector2d new_direction = direction + variation;
-    object.set_velocity(new_direction.get_normalized() * enemy_vel_);
+    enemies_.vel[i] = new_direction.get_normalized() * tuning_.enemy_vel;
   });
 }
 
-void Game::destroy_object(GameObject2d& obj, float destroy_time)
+void Game::destroy_object(const Shape& shape, const Vector2d& pos, float angle, const Vector2d& vel,
+  float rotate_speed, float destroy_time)
 {
-  auto& vertices = obj.get_vertices();
-  for (size_t i = 1; i < vertices.size(); ++i)
+  for (size_t k = 0; k < shape.get_side_count(); ++k)
   {
-    spawn_particle(vertices[i], vertices[i - 1], obj, destroy_time);
+    Vector2d centre = pos + shape.get_side_centre(k).rotate({ 0, 0 }, angle);
+    spawn_particle(shape.get_side(k), centre, angle, pos, vel, rotate_speed, destroy_time);
   }
-  spawn_particle(vertices.front(), vertices.back(), obj, destroy_time);
 }
 
-void Game::spawn_particle(const Vector2d& vertex1, const Vector2d& vertex2, const GameObject2d& obj,
-  float life_time)
+void Game::spawn_particle(const Polygon& side, const Vector2d& centre, float angle,
+  const Vector2d& pos, const Vector2d& vel, float rotate_speed, float life_time)
 {
-  Vector2d random_vel = { dim_t(rand() % 100), dim_t(rand() % 100) };
-  Vector2d pos = obj.get_position();
-  Vector2d centre = (vertex1 + vertex2) / 2;
   Vector2d momentum = centre - pos;
-  Vector2d rotate_vel = (vertex1 - vertex2) * 0.1 * obj.get_rotate_speed();
+  Vector2d rotate_vel = (side[0] - side[1]).rotate({ 0, 0 }, angle) * 0.1 * rotate_speed;
   float momentum_weight = 5;
-  particles_.emplace_front(centre,
-    obj.get_velocity() + momentum.get_normalized() * momentum_weight + rotate_vel, 0, 0, true);
-  GameObject2d& particle = particles_.front();
-  particle.add_vertex(vertex1);
-  particle.add_vertex(vertex2);
-  particle.set_rotate_speed(obj.get_rotate_speed() / 8);
-  particle.add_effect(life_time, [&]() { particle.set_active(false); });
+  particles_.emit(centre, side[0], angle,
+    vel + momentum.get_normalized() * momentum_weight + rotate_vel, rotate_speed / 8, life_time);
 }
 
 void Game::update_event(float dt)
@@ -295,50 +658,50 @@ void Game::update_event(float dt)
   std::uniform_int_distribution<int> uniform_rnd_screen_width{ 0, SCREEN_WIDTH };
   std::uniform_int_distribution<int> uniform_rnd_screen_height{ 0, SCREEN_HEIGHT };
   Vector2d player_pos = player_.get_position();
-  Vector2d rnd_pos = { dim_t(uniform_rnd_screen_width(gen)), dim_t(uniform_rnd_screen_height(gen)) };
-  while ((rnd_pos - player_pos).get_magnitude() < enemy_spawn_min_distance_)
+  Vector2d rnd_pos = { dim_t(uniform_rnd_screen_width(gen_)), dim_t(uniform_rnd_screen_height(gen_)) };
+  while ((rnd_pos - player_pos).get_magnitude() < tuning_.enemy_spawn_min_distance)
   {
-    rnd_pos = { dim_t(uniform_rnd_screen_width(gen)), dim_t(uniform_rnd_screen_height(gen)) };
+    rnd_pos = { dim_t(uniform_rnd_screen_width(gen_)), dim_t(uniform_rnd_screen_height(gen_)) };
   }
   event_time_ += dt;
   enemy_spawn_cooldown_acc_ += dt;
   switch (event_)
   {
   case Event::RandomSpawnEnemiesTargetPlayer:
-    if (enemy_spawn_cooldown_acc_ > enemy_random_spawn_cooldown_)
+    if (enemy_spawn_cooldown_acc_ > tuning_.enemy_random_spawn_cooldown)
     {
       spawn_enemy(rnd_pos);
       enemy_spawn_cooldown_acc_ = 0;
     }
-    if (event_time_ > enemy_random_spawn_event_duration_)
+    if (event_time_ > tuning_.enemy_random_spawn_event_duration)
     {
       event_time_ = 0;
       event_ = Event::FastSpawnEnemiesTargetPlayer;
     }
     break;
   case Event::FastSpawnEnemiesTargetPlayer:
-    if (enemy_spawn_cooldown_acc_ > enemy_fast_spawn_cooldown_
-      && event_time_ < enemy_fast_spawn_duration_)
+    if (enemy_spawn_cooldown_acc_ > tuning_.enemy_fast_spawn_cooldown
+      && event_time_ < tuning_.enemy_fast_spawn_duration)
     {
       spawn_enemy(rnd_pos);
       enemy_spawn_cooldown_acc_ = 0;
     }
-    if (event_time_ > enemy_fast_spawn_event_duration_)
+    if (event_time_ > tuning_.enemy_fast_spawn_event_duration)
     {
       event_time_ = 0;
       event_ = Event::BurstEnemiesTargetPlayer;
     }
     break;
   case Event::BurstEnemiesTargetPlayer:
-    if (enemy_spawn_cooldown_acc_ > enemy_burst_cooldown_)
+    if (enemy_spawn_cooldown_acc_ > tuning_.enemy_burst_cooldown)
     {
-      for (int i = 0; i < enemy_burst_size_; ++i)
+      for (int i = 0; i < tuning_.enemy_burst_size; ++i)
       {
-        player_.add_effect(enemy_burst_rate_ * i, [&, rnd_pos]() { spawn_enemy(rnd_pos); });
+        scheduler_.schedule(tuning_.enemy_burst_rate * i, [this, rnd_pos]() { spawn_enemy(rnd_pos); });
       }
       enemy_spawn_cooldown_acc_ = 0;
     }
-    if (event_time_ > enemy_burst_event_duration_)
+    if (event_time_ > tuning_.enemy_burst_event_duration)
     {
       event_time_ = 0;
       event_ = Event::RandomSpawnEnemiesTargetPlayer;
@@ -1,6 +1,15 @@
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <random>
 #include "Objects.h"
+#include "Entities.h"
+#include "Particles.h"
+#include "Scheduler.h"
+#include "FrameArena.h"
+#include "SpatialGrid.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
 
 enum class Event
 {
@@ -9,6 +18,64 @@ enum class Event
   BurstEnemiesTargetPlayer,
 };
 
+// Position and bounding box of a projectile before it moved this step, and the
+// enemies it touched on the way: chunk_hits[chunk][first_hit, first_hit + hit_count)
+struct ProjectilePath
+{
+  Vector2d from;
+  Vector2d min;
+  Vector2d max;
+  uint32_t chunk;
+  uint32_t first_hit;
+  uint32_t hit_count;
+};
+
+// Broad and narrow phase buffers of one thread detecting projectile hits
+struct CollisionScratch
+{
+  std::vector<uint32_t> candidates = {};
+  QuadBatch quads = {};   // Vertices of the candidates, tested in one batch
+  std::vector<uint8_t> hits = {};
+  CollisionStats stats = {};   // Projectile counters, summed into the game's after each tick
+};
+
+// Controls as the player holds them during a tick
+struct GameInput
+{
+  Vector2d cursor = { 0, 0 };
+  bool left = false;
+  bool right = false;
+  bool up = false;
+  bool down = false;
+  bool fire = false;      // Left mouse button
+  bool spawn = false;     // Right mouse button
+};
+
+// Constants of the enemy events, fixed for the lifetime of a game
+struct GameTuning
+{
+  dim_t enemy_vel = 500;
+  dim_t enemy_spawn_min_distance = 300;
+  float enemy_random_spawn_cooldown = 1;
+  float enemy_random_spawn_event_duration = 10;
+  float enemy_fast_spawn_cooldown = 0.2;
+  float enemy_fast_spawn_duration = 2;
+  float enemy_fast_spawn_event_duration = 5;
+  float enemy_burst_cooldown = 5;
+  float enemy_burst_size = 20;
+  float enemy_burst_rate = 0.1;
+  float enemy_burst_event_duration = 10;
+};
+
+// Totals over all rounds of a game
+struct GameStats
+{
+  uint64_t kills = 0;
+  uint64_t hits_taken = 0;
+  uint64_t deaths = 0;
+  uint32_t best_score = 0;
+};
+
 class Game
 {
   health_t player_health_ = 3;
@@ -23,73 +90,138 @@ class Game
   float enemy_spawn_rate_ = 10;
   health_t enemy_health_ = 3;
   health_t enemy_damage_ = 1;
-  dim_t enemy_vel_ = 500;
-  dim_t enemy_spawn_min_distance_ = 300;
-  float enemy_random_spawn_cooldown_ = 1;
-  float enemy_random_spawn_event_duration_ = 10;
-  float enemy_fast_spawn_cooldown_ = 0.2;
-  float enemy_fast_spawn_duration_ = 2;
-  float enemy_fast_spawn_event_duration_ = 5;
-  float enemy_burst_cooldown_ = 5;
-  float enemy_burst_size_ = 20;
-  float enemy_burst_rate_ = 0.1;
-  float enemy_burst_event_duration_ = 10;
+  GameTuning tuning_;
   float enemy_spawn_cooldown_acc_ = 0;
   float enemy_event_cooldown = 10;
-  //dim_t enemy_size_ = 25;
+  dim_t enemy_size_ = 15;
 
   dim_t projectile_vel_ = 700;
   health_t projectile_health_ = 1;
   health_t projectile_damage_ = 1;
-  //dim_t projectile_size_ = 5;
+  dim_t projectile_size_ = 5;
 
   dim_t health_size = 50;
   dim_t score_size_ = 30;
   Vector2d score_pos_ = { SCREEN_WIDTH - 50, 20 };
 
+  float tick_rate_ = 0;           // Simulation ticks per second, 0 - one tick of the frame's dt per act()
+  unsigned max_ticks_ = 8;        // Per act(), time beyond them is dropped
+  float tick_accumulator_ = 0;    // Time not simulated yet, less than a tick
+  float interpolation_ = 1;       // How far draw() is from the previous state to the current one
+  uint64_t tick_count_ = 0;
+
+  // Everything a game depends on is its own, so that any number of them can run at once
+  std::mt19937 gen_;
+  std::normal_distribution<> normal_rnd_ = std::normal_distribution<>(0, 2);
+  GameInput input_;
+  bool spawn_pressed_ = false;    // Spawn was held in the previous tick
+  GameStats stats_;
+
+  // Outlines shared by all enemies and projectiles
+  std::shared_ptr<const Shape> enemy_shape_;
+  std::shared_ptr<const Shape> projectile_shape_;
   Player player_;
   Score score_;
   Event event_ = Event::RandomSpawnEnemiesTargetPlayer;
   float event_time_ = 0;
-  std::list<GameObject2d> particles_ = std::list<GameObject2d>();
-  std::vector<Projectile> projectiles_ = std::vector<Projectile>(100);
-  std::vector<Enemy> enemies_ = std::vector<Enemy>(100);
+  ParticleSystem particles_ = ParticleSystem(8192);
+  EntityStore projectiles_;
+  EntityStore enemies_;
+  SpatialGrid enemy_grid_ = SpatialGrid(64);
+  std::vector<uint32_t> collision_candidates_ = std::vector<uint32_t>();
+
+  // A tick as a graph of tasks, its parallel phases run entities in chunks that
+  // do not depend on the thread count, neither do the results
+  JobSystem& jobs_;
+  TaskGraph tasks_;
+  float tick_dt_ = 0;
+  ProjectilePath* paths_ = nullptr;     // Of the projectiles of the current tick, in the frame arena
+  size_t entity_chunk_ = 64;
+  size_t projectile_chunk_ = 8;
+  size_t particle_chunk_ = 1024;
+  // Reserved for the busiest events, so that a running game does not allocate
+  uint32_t enemy_reserve_ = 256;
+  uint32_t projectile_reserve_ = 64;
+  size_t projectile_hit_reserve_ = 0;     // Per projectile, a whole burst, set from the tuning
+  size_t timer_reserve_ = 1024;
+  size_t candidate_reserve_ = 1024;       // Grid queries list an enemy once per cell before removing duplicates
+  std::vector<CollisionScratch> collision_scratch_ = {};     // By worker
+  std::vector<std::vector<Handle>> chunk_hits_ = {};         // Enemies hit, by chunk of projectiles
+  CollisionStats collision_stats_ = {};   // Of the projectile paths of all ticks
+  FrameArena frame_arena_ = FrameArena(1 << 16);   // Scratch data of the current tick
+  Scheduler scheduler_;   // Delayed effects of all objects and events
+
+  // Runs effect(i) after delay with the entity's index i, unless it was removed by then
+  template<typename F>
+  void schedule(EntityStore& store, const Handle& handle, float delay, F effect)
+  {
+    scheduler_.schedule(delay, [&store, handle, effect]()
+    {
+      uint32_t i = store.get_index(handle);
+      if (i != EntityStore::npos && store.active[i])
+        effect(i);
+    });
+  }
+
+  // Whether projectile touched enemy on its way from from
+  bool is_swept_intersect(const Vector2d& from, uint32_t projectile, uint32_t enemy) const;
+  // Enemies the projectiles [begin, end) touched on their paths and have not hit
+  // before, appended to hits in candidate order and recorded in their paths.
+  // Only reads the game state.
+  void detect_hits(ProjectilePath* paths, uint32_t begin, uint32_t end,
+    CollisionScratch& scratch, std::vector<Handle>& hits) const;
+  // Updates the transforms of the enemies and rebuilds the grid from the active ones
+  void build_enemy_grid();
+  void reserve_scratch(unsigned thread_count);
+  // One step of the simulation, running the tasks below
+  void tick(float dt);
+  void move_projectiles(float dt);
+  void detect_collisions();
+  // Applies the hits detected, in order
+  void resolve_hits();
+  void update_enemies(float dt);
+  void collide_player();
+  void update_particles(float dt);
 public:
-  Game();
+  Game(JobSystem& jobs, uint32_t seed, const GameTuning& tuning = GameTuning());
+  Game(const Game&) = delete;
+  Game& operator=(const Game&) = delete;
+  // Restarts the random sequence, before the first tick the game plays as if constructed with seed
+  void reseed(uint32_t seed);
+  // Simulates dt seconds, in ticks of 1 / tick rate when one is set. draw() then
+  // shows the state interpolated between the last two ticks by the time left over.
+  void advance(float dt);
+  // 0 goes back to one tick per advance()
+  void set_tick_rate(float rate);
+  float get_tick_rate() const { return tick_rate_; }
+  uint64_t get_tick_count() const { return tick_count_; }
+  // Tasks of a tick, with their times
+  const TaskGraph& get_tasks() const { return tasks_; }
+  // Controls for the following ticks
+  void set_input(const GameInput& input) { input_ = input; }
+  const GameTuning& get_tuning() const { return tuning_; }
+  const GameStats& get_stats() const { return stats_; }
+  const Player& get_player() const { return player_; }
+  const EntityStore& get_enemies() const { return enemies_; }
+  // Object2d's counters and those of the projectile paths of all ticks
+  CollisionStats get_collision_stats() const;
   void control(float dt);
-  void update(float dt);
   void update_event(float dt);
-  void draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const;
+  void draw(RenderQueue& queue) const;
   void shoot();
   void reset();
   void spawn_enemy(const Vector2d& pos);
-  void spawn_particle(const Vector2d& vertex1, const Vector2d& vertex2, const GameObject2d& obj,
-    float life_time);
-  void destroy_object(GameObject2d& obj, float destroy_time);
-  template<typename T>
-  T& spawn_object(std::vector<T>& container, const Vector2d& pos, const Vector2d& vel,
-    health_t health, health_t damage, bool active);
+  // Particle of side shaped like side, which object at pos broke off at centre
+  void spawn_particle(const Polygon& side, const Vector2d& centre, float angle,
+    const Vector2d& pos, const Vector2d& vel, float rotate_speed, float life_time);
+  // Breaks the outline of an object into particles, one per side
+  void destroy_object(const Shape& shape, const Vector2d& pos, float angle, const Vector2d& vel,
+    float rotate_speed, float destroy_time);
+  Handle spawn_object(EntityStore& store, const Shape& shape, const Vector2d& pos, const Vector2d& vel,
+    health_t health, health_t damage);
 };
 
-template<typename T>
-T& Game::spawn_object(std::vector<T>& container, const Vector2d& pos, const Vector2d& vel,
-  health_t health, health_t damage, bool active)
-{
-  auto object = std::find_if(container.begin(), container.end(),
-    [](const T& object) { return !object.is_active(); });
-  if (object != std::end(container))
-  {
-    object->reset();
-    object->set_position(pos);
-    object->set_velocity(vel);
-    object->set_health(health);
-    object->set_damage(damage);
-    object->set_active(active);
-    return *object;
-  }
-  else
-  {
-    container.emplace_back(pos, vel, health, damage, active);
-    return container.back();
-  }
-}
+extern JobSystem jobs;
+extern Game game;
+extern Renderer renderer;
+extern RenderPipeline render_pipeline;
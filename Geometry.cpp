@@ -1,245 +1,679 @@
 #include "Geometry.h"
+#include "FastMath.h"
 #include <cmath>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <cstddef>
+#include <map>
+#include <array>
+#include <mutex>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEOMETRY_SSE2
+#endif
 
 void Geometry::draw_rectangle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, dim_t hl, dim_t hw, float angle, uint32_t color)
+  const Vector2d& pos, dim_t hl, dim_t hw, float angle, uint32_t color, const ClipRect& clip)
 {
-  Vector2d v1 = Vector2d(pos.x - hl, pos.y - hw).rotate(pos, angle);
-  Vector2d v2 = Vector2d(pos.x + hl, pos.y - hw).rotate(pos, angle);
-  Vector2d v3 = Vector2d(pos.x + hl, pos.y + hw).rotate(pos, angle);
-  Vector2d v4 = Vector2d(pos.x - hl, pos.y + hw).rotate(pos, angle);
-  draw_line(buffer, v1, v2, color);
-  draw_line(buffer, v2, v3, color);
-  draw_line(buffer, v3, v4, color);
-  draw_line(buffer, v4, v1, color);
+  Vector2d v[4] = {
+    { pos.x - hl, pos.y - hw },
+    { pos.x + hl, pos.y - hw },
+    { pos.x + hl, pos.y + hw },
+    { pos.x - hl, pos.y + hw },
+  };
+  rotate_many(v, 4, pos, angle);
+  draw_line(buffer, v[0], v[1], color, clip);
+  draw_line(buffer, v[1], v[2], color, clip);
+  draw_line(buffer, v[2], v[3], color, clip);
+  draw_line(buffer, v[3], v[0], color, clip);
+}
+
+void Geometry::draw_span(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+  int y, int x0, int x1, uint32_t color, const ClipRect& clip)
+{
+  if (y < clip.y0 || y >= clip.y1)
+    return;
+
+  x0 = std::max(x0, clip.x0);
+  x1 = std::min(x1, clip.x1);
+  if (x0 < x1)
+    std::fill(buffer[y] + x0, buffer[y] + x1, color);
 }
 
 void Geometry::draw_fill_rectangle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, dim_t h, dim_t w, uint32_t color)
+  const Vector2d& pos, dim_t h, dim_t w, uint32_t color, const ClipRect& clip)
 {
-  for (dim_t y = pos.y; y < pos.y + h; ++y)
-  {
-    for (dim_t x = pos.x; x < pos.x + w; ++x)
-    {
-      if (BORDER_CHECK(x, y))
-        buffer[uint32_t(y)][uint32_t(x)] = color;
-    }
-  }
+  int left = int(floor(pos.x));
+  int top = int(floor(pos.y));
+  int x0 = std::max(left, clip.x0);
+  int x1 = std::min(left + int(ceil(w)), clip.x1);
+  int y0 = std::max(top, clip.y0);
+  int y1 = std::min(top + int(ceil(h)), clip.y1);
+  if (x0 >= x1)
+    return;
+
+  for (int y = y0; y < y1; ++y)
+    std::fill(buffer[y] + x0, buffer[y] + x1, color);
 }
 
 void Geometry::draw_triangle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, dim_t size, float angle, uint32_t color)
+  const Vector2d& pos, dim_t size, float angle, uint32_t color, const ClipRect& clip)
 {
   float R = size / sqrt(3);
-  Vector2d v1 = Vector2d(pos.x, pos.y - R).rotate(pos, angle);
-  Vector2d v2 = Vector2d(pos.x + size / 2, pos.y + R / 2).rotate(pos, angle);
-  Vector2d v3 = Vector2d(pos.x - size / 2, pos.y + R / 2).rotate(pos, angle);
-  draw_line(buffer, v1, v3, color);
-  draw_line(buffer, v1, v2, color);
-  draw_line(buffer, v2, v3, color);
+  Vector2d v[3] = {
+    { pos.x, pos.y - R },
+    { pos.x + size / 2, pos.y + R / 2 },
+    { pos.x - size / 2, pos.y + R / 2 },
+  };
+  rotate_many(v, 3, pos, angle);
+  draw_line(buffer, v[0], v[2], color, clip);
+  draw_line(buffer, v[0], v[1], color, clip);
+  draw_line(buffer, v[1], v[2], color, clip);
 }
 
-void Geometry::draw_circle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, dim_t r, uint32_t color)
+// Calls emit(y, x0, x1) for every row of the disc of radius r centred at the origin
+template<typename F>
+static void for_each_circle_span(dim_t r, F emit)
 {
-  int rr = r * r;
-  for (int y = 0; y < r; ++y)
+  int n = int(ceil(r));
+  int rr = int(r * r);
+  // Half-width of the row shrinks monotonically as the row moves away from the centre
+  int hx = n - 1;
+  for (int y = 0; y < n; ++y)
   {
     int yy = y * y;
-    for (int x = 0; x < r; ++x)
+    while (hx >= 0 && hx * hx + yy > rr)
+      --hx;
+    if (hx < 0)
+      break;
+
+    emit(y, -hx, hx + 1);
+    if (y != 0)
+      emit(-y, -hx, hx + 1);
+  }
+}
+
+void Geometry::draw_circle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+  const Vector2d& pos, dim_t r, uint32_t color, const ClipRect& clip)
+{
+  int n = int(ceil(r));
+  int cx = int(floor(pos.x));
+  int cy = int(floor(pos.y));
+  if (cx + n <= clip.x0 || cx - n >= clip.x1 || cy + n <= clip.y0 || cy - n >= clip.y1)
+    return;
+
+  for_each_circle_span(r, [&](int y, int x0, int x1)
+  {
+    draw_span(buffer, cy + y, cx + x0, cx + x1, color, clip);
+  });
+}
+
+// Clamps far off-screen endpoints into a guard band so that the integer
+// arithmetic below can not overflow; lines that short never reach it.
+static bool clip_to_guard_band(Vector2d& p1, Vector2d& p2)
+{
+  if (!std::isfinite(p1.x) || !std::isfinite(p1.y) || !std::isfinite(p2.x) || !std::isfinite(p2.y))
+    return false;
+
+  const dim_t guard = 1 << 20;
+  const dim_t min_x = -guard, max_x = SCREEN_WIDTH + guard;
+  const dim_t min_y = -guard, max_y = SCREEN_HEIGHT + guard;
+  dim_t t0 = 0, t1 = 1;
+  dim_t dx = p2.x - p1.x;
+  dim_t dy = p2.y - p1.y;
+  const dim_t p[4] = { -dx, dx, -dy, dy };
+  const dim_t q[4] = { p1.x - min_x, max_x - p1.x, p1.y - min_y, max_y - p1.y };
+  for (int i = 0; i < 4; ++i)
+  {
+    if (p[i] == 0)
     {
-      if (x * x + yy <= rr)
-      {
-        if (BORDER_CHECK(pos.x + x, pos.y + y))
-          buffer[uint32_t(pos.y + y)][uint32_t(pos.x + x)] = color;
-        if (BORDER_CHECK(pos.x + x, pos.y - y))
-          buffer[uint32_t(pos.y - y)][uint32_t(pos.x + x)] = color;
-        if (BORDER_CHECK(pos.x - x, pos.y + y))
-          buffer[uint32_t(pos.y + y)][uint32_t(pos.x - x)] = color;
-        if (BORDER_CHECK(pos.x - x, pos.y - y))
-          buffer[uint32_t(pos.y - y)][uint32_t(pos.x - x)] = color;
-      }
+      if (q[i] < 0)
+        return false;
+      continue;
     }
+    dim_t t = q[i] / p[i];
+    if (p[i] < 0)
+      t0 = std::max(t0, t);
+    else
+      t1 = std::min(t1, t);
+  }
+  if (t0 > t1)
+    return false;
+
+  Vector2d start = { p1.x + t0 * dx, p1.y + t0 * dy };
+  p2 = { p1.x + t1 * dx, p1.y + t1 * dy };
+  p1 = start;
+  return true;
+}
+
+// Range [first, last] of steps i for which major + dir * i lies in [lo, hi)
+static void clip_major(int64_t major, int64_t dir, int64_t lo, int64_t hi,
+  int64_t& first, int64_t& last)
+{
+  if (dir > 0)
+  {
+    first = std::max(first, lo - major);
+    last = std::min(last, hi - 1 - major);
+  }
+  else
+  {
+    first = std::max(first, major - (hi - 1));
+    last = std::min(last, major - lo);
   }
 }
 
+// Same for the minor axis, which advances by floor(i * d_minor / d_major) at step i
+static void clip_minor(int64_t minor, int64_t dir, int64_t lo, int64_t hi,
+  int64_t d_major, int64_t d_minor, int64_t& first, int64_t& last)
+{
+  int64_t q_lo = (dir > 0) ? lo - minor : minor - (hi - 1);
+  int64_t q_hi = (dir > 0) ? hi - 1 - minor : minor - lo;
+  if (q_hi < 0 || (d_minor == 0 && q_lo > 0))
+  {
+    last = -1;
+    return;
+  }
+  if (q_lo > 0)
+    first = std::max(first, (q_lo * d_major + d_minor - 1) / d_minor);
+  if (d_minor != 0)
+    last = std::min(last, ((q_hi + 1) * d_major - 1) / d_minor);
+}
+
 void Geometry::draw_line(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos1, const Vector2d& pos2, uint32_t color)
-{
-  dim_t xerr = 0;
-  dim_t yerr = 0;
-  dim_t dx = pos2.x - pos1.x;
-  dim_t x_dir = (dx > 0) ? 1 : -1;
-  dim_t abs_dx = (dx > 0) ? dx : -dx;
-  dim_t dy = pos2.y - pos1.y;
-  dim_t y_dir = (dy > 0) ? 1 : -1;
-  dim_t abs_dy = (dy > 0) ? dy : -dy;
-  dim_t max_dx_dy = (abs_dx > abs_dy) ? abs_dx : abs_dy;
-  dim_t x = pos1.x;
-  dim_t y = pos1.y;
-  if (BORDER_CHECK(x, y))
-    buffer[uint32_t(y)][uint32_t(x)] = color;
-  for (dim_t i = 0; i < max_dx_dy; ++i)
-  {
-    xerr += abs_dx;
-    if (xerr >= max_dx_dy)
+  const Vector2d& pos1, const Vector2d& pos2, uint32_t color, const ClipRect& clip)
+{
+  Vector2d p1 = pos1;
+  Vector2d p2 = pos2;
+  const dim_t guard = 1 << 20;
+  if (!(std::abs(p1.x) < guard && std::abs(p1.y) < guard
+    && std::abs(p2.x) < guard && std::abs(p2.y) < guard)
+    && !clip_to_guard_band(p1, p2))
+    return;
+
+  int64_t x1 = int64_t(floor(p1.x));
+  int64_t y1 = int64_t(floor(p1.y));
+  int64_t x2 = int64_t(floor(p2.x));
+  int64_t y2 = int64_t(floor(p2.y));
+
+  // Trivial reject when both endpoints are beyond the same clip edge
+  if ((x1 < clip.x0 && x2 < clip.x0) || (x1 >= clip.x1 && x2 >= clip.x1)
+    || (y1 < clip.y0 && y2 < clip.y0) || (y1 >= clip.y1 && y2 >= clip.y1))
+    return;
+
+  int64_t x_dir = (x2 >= x1) ? 1 : -1;
+  int64_t y_dir = (y2 >= y1) ? 1 : -1;
+  int64_t abs_dx = (x2 - x1) * x_dir;
+  int64_t abs_dy = (y2 - y1) * y_dir;
+  bool x_major = abs_dx >= abs_dy;
+  int64_t d_major = x_major ? abs_dx : abs_dy;
+  int64_t d_minor = x_major ? abs_dy : abs_dx;
+
+  // Clip in step space, so the visible part keeps the pixels of the whole line
+  // and tiles drawing the same line with different clips agree on every pixel
+  int64_t first = 0;
+  int64_t last = d_major;
+  if (x_major)
+  {
+    clip_major(x1, x_dir, clip.x0, clip.x1, first, last);
+    clip_minor(y1, y_dir, clip.y0, clip.y1, d_major, d_minor, first, last);
+  }
+  else
+  {
+    clip_major(y1, y_dir, clip.y0, clip.y1, first, last);
+    clip_minor(x1, x_dir, clip.x0, clip.x1, d_major, d_minor, first, last);
+  }
+  if (first > last)
+    return;
+
+  int64_t minor_offset = (d_major != 0) ? first * d_minor / d_major : 0;
+  int64_t err = (d_major != 0) ? first * d_minor % d_major : 0;
+  int64_t x = x1 + x_dir * (x_major ? first : minor_offset);
+  int64_t y = y1 + y_dir * (x_major ? minor_offset : first);
+
+  ptrdiff_t x_step = ptrdiff_t(x_dir);
+  ptrdiff_t y_step = ptrdiff_t(y_dir) * SCREEN_WIDTH;
+  ptrdiff_t major_step = x_major ? x_step : y_step;
+  ptrdiff_t minor_step = x_major ? y_step : x_step;
+  uint32_t* pixels = &buffer[0][0];
+  ptrdiff_t offset = ptrdiff_t(y) * SCREEN_WIDTH + ptrdiff_t(x);
+  for (int64_t i = first; i <= last; ++i)
+  {
+    pixels[offset] = color;
+    offset += major_step;
+    err += d_minor;
+    if (err >= d_major)
     {
-      xerr -= max_dx_dy;
-      x += x_dir;
+      err -= d_major;
+      offset += minor_step;
     }
-    yerr += abs_dy;
-    if (yerr >= max_dx_dy)
+  }
+}
+
+// Lit segments of every digit, bit i stands for DigitSegment(i)
+static constexpr uint8_t digit_segments[10] = { 0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f };
+
+// Segment end points in units of digit size relative to the digit position
+static constexpr int segment_ends[7][4] =
+{
+  { 0, 0, -1, 0 },    // a
+  { 0, 0, 0, 1 },     // b
+  { 0, 1, 0, 2 },     // c
+  { 0, 2, -1, 2 },    // d
+  { -1, 1, -1, 2 },   // e
+  { -1, 0, -1, 1 },   // f
+  { 0, 1, -1, 1 },    // g
+};
+
+void Geometry::draw_digit(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+  const Vector2d& pos, uint32_t digit, dim_t size, uint32_t color, const ClipRect& clip)
+{
+  if (digit > 9)
+    throw std::invalid_argument("Digit must be in range [0, 9]");
+
+  for (int segment = 0; segment < 7; ++segment)
+  {
+    if (digit_segments[digit] & (1 << segment))
+      draw_segment(buffer, pos, DigitSegment(segment), size, color, clip);
+  }
+}
+
+void Geometry::draw_segment(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+  const Vector2d& pos, DigitSegment segment, dim_t size, uint32_t color, const ClipRect& clip)
+{
+  const int* ends = segment_ends[int(segment)];
+  draw_line(buffer, { pos.x + ends[0] * size, pos.y + ends[1] * size },
+    { pos.x + ends[2] * size, pos.y + ends[3] * size }, color, clip);
+}
+
+void Geometry::draw_mask(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+  const SpanMask& mask, int x, int y, uint32_t color, const ClipRect& clip)
+{
+  if (x + mask.bounds.x1 <= clip.x0 || x + mask.bounds.x0 >= clip.x1
+    || y + mask.bounds.y1 <= clip.y0 || y + mask.bounds.y0 >= clip.y1)
+    return;
+
+  if (x + mask.bounds.x0 >= clip.x0 && x + mask.bounds.x1 <= clip.x1
+    && y + mask.bounds.y0 >= clip.y0 && y + mask.bounds.y1 <= clip.y1)
+  {
+    for (const auto& span : mask.spans)
+      std::fill(buffer[y + span.y] + x + span.x0, buffer[y + span.y] + x + span.x1, color);
+    return;
+  }
+
+  for (const auto& span : mask.spans)
+    draw_span(buffer, y + span.y, x + span.x0, x + span.x1, color, clip);
+}
+
+void Geometry::add_span(SpanMask& mask, const Span& span)
+{
+  if (mask.spans.empty())
+    mask.bounds = { span.x0, span.y, span.x1, span.y + 1 };
+  mask.bounds.x0 = std::min(mask.bounds.x0, span.x0);
+  mask.bounds.x1 = std::max(mask.bounds.x1, span.x1);
+  mask.bounds.y0 = std::min(mask.bounds.y0, span.y);
+  mask.bounds.y1 = std::max(mask.bounds.y1, span.y + 1);
+  mask.spans.push_back(span);
+}
+
+void Geometry::add_bitmap_spans(SpanMask& mask, const std::vector<uint8_t>& bitmap,
+  int width, int height, int x, int y)
+{
+  for (int row = 0; row < height; ++row)
+  {
+    const uint8_t* bits = &bitmap[row * width];
+    for (int col = 0; col < width; ++col)
     {
-      yerr -= max_dx_dy;
-      y += y_dir;
+      if (!bits[col])
+        continue;
+
+      int run_end = col + 1;
+      while (run_end < width && bits[run_end])
+        ++run_end;
+
+      add_span(mask, { y + row, x + col, x + run_end });
+      col = run_end;
     }
-    if (BORDER_CHECK(x, y))
-      buffer[uint32_t(y)][uint32_t(x)] = color;
   }
 }
 
-void Geometry::draw_digit(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, uint32_t digit, dim_t size, uint32_t color)
+const SpanMask& Geometry::get_stamp(StampShape shape, int size)
 {
-  switch (digit)
+  // Map nodes do not move, so a stamp stays valid after the lock is released
+  static std::mutex mutex;
+  static std::map<std::pair<StampShape, int>, SpanMask> stamps;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto key = std::make_pair(shape, size);
+  auto found = stamps.find(key);
+  if (found != stamps.end())
+    return found->second;
+
+  SpanMask& stamp = stamps[key];
+  switch (shape)
   {
-  case 0:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    draw_segment(buffer, pos, DigitSegment::e, size, color);
-    draw_segment(buffer, pos, DigitSegment::f, size, color);
-    break;
-  case 1:
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    break;
-  case 2:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
-    draw_segment(buffer, pos, DigitSegment::e, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    break;
-  case 3:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    break;
-  case 4:
-    draw_segment(buffer, pos, DigitSegment::f, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    break;
-  case 5:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::f, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    break;
-  case 6:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::f, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    draw_segment(buffer, pos, DigitSegment::e, size, color);
-    break;
-  case 7:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    break;
-  case 8:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    draw_segment(buffer, pos, DigitSegment::e, size, color);
-    draw_segment(buffer, pos, DigitSegment::f, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
+  case StampShape::Circle:
+    for_each_circle_span(dim_t(size), [&](int y, int x0, int x1) { add_span(stamp, { y, x0, x1 }); });
     break;
-  case 9:
-    draw_segment(buffer, pos, DigitSegment::a, size, color);
-    draw_segment(buffer, pos, DigitSegment::b, size, color);
-    draw_segment(buffer, pos, DigitSegment::c, size, color);
-    draw_segment(buffer, pos, DigitSegment::d, size, color);
-    draw_segment(buffer, pos, DigitSegment::f, size, color);
-    draw_segment(buffer, pos, DigitSegment::g, size, color);
-    break;
-  default:
+  }
+  return stamp;
+}
+
+const SpanMask& Geometry::get_digit_glyph(uint32_t digit, int size)
+{
+  if (digit > 9)
     throw std::invalid_argument("Digit must be in range [0, 9]");
-    break;
+
+  static std::mutex mutex;
+  static std::map<int, std::array<SpanMask, 10>> glyphs;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = glyphs.find(size);
+  if (found != glyphs.end())
+    return found->second[digit];
+
+  // Segments are axis aligned, so every integral point between their ends is lit
+  std::array<SpanMask, 10>& atlas = glyphs[size];
+  int width = size + 1;
+  int height = 2 * size + 1;
+  for (uint32_t d = 0; d < 10; ++d)
+  {
+    std::vector<uint8_t> bitmap(width * height);
+    for (int segment = 0; segment < 7; ++segment)
+    {
+      if (!(digit_segments[d] & (1 << segment)))
+        continue;
+
+      const int* ends = segment_ends[segment];
+      int x0 = std::min(ends[0], ends[2]) * size + size;
+      int x1 = std::max(ends[0], ends[2]) * size + size;
+      int y0 = std::min(ends[1], ends[3]) * size;
+      int y1 = std::max(ends[1], ends[3]) * size;
+      for (int y = y0; y <= y1; ++y)
+        std::fill(&bitmap[y * width + x0], &bitmap[y * width + x1] + 1, 1);
+    }
+    add_bitmap_spans(atlas[d], bitmap, width, height, -size, 0);
   }
+  return atlas[digit];
 }
 
-void Geometry::draw_segment(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, DigitSegment segment, dim_t size, uint32_t color)
+bool Geometry::is_intersect(const Vector2d* vertices1, size_t count1,
+  const Vector2d* vertices2, size_t count2)
+{
+  if (count1 == 3 && count2 == 3)
+    return is_intersect<3, 3>(vertices1, vertices2);
+  if (count1 == 3 && count2 == 4)
+    return is_intersect<3, 4>(vertices1, vertices2);
+  if (count1 == 4 && count2 == 3)
+    return is_intersect<4, 3>(vertices1, vertices2);
+  if (count1 == 4 && count2 == 4)
+    return is_intersect<4, 4>(vertices1, vertices2);
+
+  return !has_separating_edge(vertices1, count1, vertices2, count2) &&
+    !has_separating_edge(vertices2, count2, vertices1, count1);
+}
+
+bool Geometry::is_intersect(const Polygon& polygon1, const Polygon& polygon2)
 {
-  switch (segment)
+  return is_intersect(polygon1.data(), polygon1.size(), polygon2.data(), polygon2.size());
+}
+
+void QuadBatch::clear()
+{
+  for (size_t k = 0; k < 4; ++k)
   {
-  case DigitSegment::a:
-    draw_line(buffer, pos, { pos.x - size, pos.y }, color);
-    break;
-  case DigitSegment::b:
-    draw_line(buffer, pos, { pos.x, pos.y + size }, color);
-    break;
-  case DigitSegment::c:
-    draw_line(buffer, { pos.x, pos.y + size }, { pos.x , pos.y + 2 * size }, color);
-    break;
-  case DigitSegment::d:
-    draw_line(buffer, { pos.x , pos.y + 2 * size }, { pos.x - size, pos.y + 2 * size }, color);
-    break;
-  case DigitSegment::e:
-    draw_line(buffer, { pos.x - size, pos.y + size }, { pos.x - size, pos.y + 2 * size }, color);
-    break;
-  case DigitSegment::f:
-    draw_line(buffer, { pos.x - size , pos.y }, { pos.x - size, pos.y + size }, color);
-    break;
-  case DigitSegment::g:
-    draw_line(buffer, { pos.x , pos.y + size }, { pos.x - size, pos.y + size }, color);
-    break;
+    x_[k].clear();
+    y_[k].clear();
   }
 }
 
-Vector2d Geometry::get_axis_projection(const std::vector<Vector2d>& vertices, const Vector2d& axis)
+void QuadBatch::reserve(size_t count)
 {
-  std::vector<dim_t> projections = std::vector<dim_t>(vertices.size());
-  std::transform(vertices.cbegin(), vertices.cend(), projections.begin(),
-    [&](const Vector2d& v) { return v * axis; });
-  const auto minmax = std::minmax_element(projections.cbegin(), projections.cend());
-  return { *minmax.first, *minmax.second };
+  for (size_t k = 0; k < 4; ++k)
+  {
+    x_[k].reserve(count);
+    y_[k].reserve(count);
+  }
 }
 
-bool Geometry::is_intersect(const std::vector<Vector2d>& vertices1,
-  const std::vector<Vector2d>& vertices2)
+void QuadBatch::push_back(const Polygon& quad)
 {
-  std::vector<Vector2d> perpendicularAxes = {};
-  perpendicularAxes.reserve(vertices1.size() + vertices2.size());
-  for (size_t i = 1; i < vertices1.size(); ++i)
-    perpendicularAxes.emplace_back((vertices1[i] - vertices1[i - 1]).get_normalized().get_norm());
+  if (quad.size() != 4)
+    throw std::invalid_argument("QuadBatch accepts quads only");
 
-  perpendicularAxes.emplace_back((vertices1.front() - vertices1.back()).get_normalized().get_norm());
-  for (size_t i = 1; i < vertices2.size(); ++i)
-    perpendicularAxes.emplace_back((vertices2[i] - vertices2[i - 1]).get_normalized().get_norm());
+  for (size_t k = 0; k < 4; ++k)
+  {
+    x_[k].push_back(quad[k].x);
+    y_[k].push_back(quad[k].y);
+  }
+}
 
-  perpendicularAxes.emplace_back((vertices2.front() - vertices2.back()).get_normalized().get_norm());
+Shape::Shape(const Polygon& outline)
+  : outline_(outline)
+{
+  size_t count = outline.size();
+  for (size_t k = 0; k < count; ++k)
+  {
+    const Vector2d& v1 = outline[(k + 1) % count];
+    const Vector2d& v2 = outline[k];
+    Vector2d centre = (v1 + v2) / 2;
+    side_centres_[k] = centre;
+    sides_[k].push_back(v1 - centre);
+    sides_[k].push_back(v2 - centre);
+  }
+}
 
-  bool intersect = std::all_of(perpendicularAxes.cbegin(), perpendicularAxes.cend(),
-    [&](const Vector2d& axis)
+void Geometry::transform(const Polygon& model, const Vector2d& pos, float angle,
+  Polygon& world, Vector2d& min, Vector2d& max)
+{
+  dim_t s, c;
+  fast_sin_cos(angle, s, c);
+  world = Polygon();
+  min = max = pos;
+  for (size_t k = 0; k < model.size(); ++k)
   {
-    Vector2d project1 = get_axis_projection(vertices1, axis);
-    Vector2d project2 = get_axis_projection(vertices2, axis);
-    return project1.x <= project2.y && project1.y >= project2.x;
-  });
+    const Vector2d& v = model[k];
+    Vector2d w = { pos.x + (v.x * c - v.y * s), pos.y + (v.x * s + v.y * c) };
+    world.push_back(w);
+    if (k == 0)
+    {
+      min = max = w;
+    }
+    else
+    {
+      min = { std::min(min.x, w.x), std::min(min.y, w.y) };
+      max = { std::max(max.x, w.x), std::max(max.y, w.y) };
+    }
+  }
+}
 
-  return intersect;
+// Lane operations for intersect_lanes. Multiplications and additions are kept
+// separate, as in the scalar SAT, so that the results match it exactly.
+#if defined(__AVX__)
+struct SimdLanes
+{
+  typedef __m256 type;
+  static const size_t width = 8;
+  static type load(const dim_t* p) { return _mm256_loadu_ps(p); }
+  static type set(dim_t v) { return _mm256_set1_ps(v); }
+  static type add(type a, type b) { return _mm256_add_ps(a, b); }
+  static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+  static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+  static type min(type a, type b) { return _mm256_min_ps(a, b); }
+  static type max(type a, type b) { return _mm256_max_ps(a, b); }
+  static type bit_or(type a, type b) { return _mm256_or_ps(a, b); }
+  static type less(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static int mask(type a) { return _mm256_movemask_ps(a); }
+};
+#elif defined(GEOMETRY_SSE2)
+struct SimdLanes
+{
+  typedef __m128 type;
+  static const size_t width = 4;
+  static type load(const dim_t* p) { return _mm_loadu_ps(p); }
+  static type set(dim_t v) { return _mm_set1_ps(v); }
+  static type add(type a, type b) { return _mm_add_ps(a, b); }
+  static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+  static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+  static type min(type a, type b) { return _mm_min_ps(a, b); }
+  static type max(type a, type b) { return _mm_max_ps(a, b); }
+  static type bit_or(type a, type b) { return _mm_or_ps(a, b); }
+  static type less(type a, type b) { return _mm_cmplt_ps(a, b); }
+  static int mask(type a) { return _mm_movemask_ps(a); }
+};
+#endif
+
+#if defined(__AVX__) || defined(GEOMETRY_SSE2)
+// SAT of polygon against quads [first, first + width), one quad per lane
+template<typename S>
+static void intersect_lanes(const Polygon& polygon, const QuadBatch& quads, size_t first,
+  uint8_t* result)
+{
+  typename S::type x[4];
+  typename S::type y[4];
+  for (size_t k = 0; k < 4; ++k)
+  {
+    x[k] = S::load(quads.get_x(k) + first);
+    y[k] = S::load(quads.get_y(k) + first);
+  }
+  typename S::type separated = S::set(0);
+
+  // Edge normals of the polygon are shared by all lanes
+  for (size_t i = 0; i < polygon.size(); ++i)
+  {
+    const Vector2d& next = polygon[i + 1 == polygon.size() ? 0 : i + 1];
+    Vector2d axis = (next - polygon[i]).get_norm();
+    Vector2d project = Geometry::get_axis_projection(polygon.data(), polygon.size(), axis);
+    typename S::type ax = S::set(axis.x);
+    typename S::type ay = S::set(axis.y);
+    typename S::type min = S::add(S::mul(x[0], ax), S::mul(y[0], ay));
+    typename S::type max = min;
+    for (size_t k = 1; k < 4; ++k)
+    {
+      typename S::type p = S::add(S::mul(x[k], ax), S::mul(y[k], ay));
+      min = S::min(min, p);
+      max = S::max(max, p);
+    }
+    separated = S::bit_or(separated, S::bit_or(
+      S::less(S::set(project.y), min), S::less(max, S::set(project.x))));
+  }
+
+  // Edge normals of the quads differ per lane
+  for (size_t k = 0; k < 4; ++k)
+  {
+    size_t next = k + 1 == 4 ? 0 : k + 1;
+    typename S::type ax = S::sub(y[next], y[k]);
+    typename S::type ay = S::sub(x[k], x[next]);
+    typename S::type min = S::add(S::mul(x[0], ax), S::mul(y[0], ay));
+    typename S::type max = min;
+    for (size_t j = 1; j < 4; ++j)
+    {
+      typename S::type p = S::add(S::mul(x[j], ax), S::mul(y[j], ay));
+      min = S::min(min, p);
+      max = S::max(max, p);
+    }
+    typename S::type polygon_min = S::add(S::mul(S::set(polygon[0].x), ax), S::mul(S::set(polygon[0].y), ay));
+    typename S::type polygon_max = polygon_min;
+    for (size_t j = 1; j < polygon.size(); ++j)
+    {
+      typename S::type p = S::add(S::mul(S::set(polygon[j].x), ax), S::mul(S::set(polygon[j].y), ay));
+      polygon_min = S::min(polygon_min, p);
+      polygon_max = S::max(polygon_max, p);
+    }
+    separated = S::bit_or(separated, S::bit_or(
+      S::less(polygon_max, min), S::less(max, polygon_min)));
+  }
+
+  int mask = S::mask(separated);
+  for (size_t i = 0; i < S::width; ++i)
+    result[i] = (mask >> i) & 1 ? 0 : 1;
+}
+#endif
+
+void Geometry::intersect_batch(const Polygon& polygon, const QuadBatch& quads, uint8_t* result)
+{
+  size_t i = 0;
+#if defined(__AVX__) || defined(GEOMETRY_SSE2)
+  if (!polygon.empty())
+  {
+    for (; i + SimdLanes::width <= quads.size(); i += SimdLanes::width)
+      intersect_lanes<SimdLanes>(polygon, quads, i, result + i);
+  }
+#endif
+  for (; i < quads.size(); ++i)
+  {
+    Vector2d quad[4];
+    for (size_t k = 0; k < 4; ++k)
+      quad[k] = { quads.get_x(k)[i], quads.get_y(k)[i] };
+    result[i] = is_intersect(polygon.data(), polygon.size(), quad, 4);
+  }
+}
+
+static dim_t cross(const Vector2d& a, const Vector2d& b)
+{
+  return a.x * b.y - a.y * b.x;
+}
+
+static dim_t get_segment_distance_sq(const Vector2d& p, const Vector2d& a, const Vector2d& b)
+{
+  Vector2d ab = b - a;
+  Vector2d ap = p - a;
+  dim_t len_sq = ab * ab;
+  dim_t t = len_sq > 0 ? (ap * ab) / len_sq : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  Vector2d d = ap - ab * t;
+  return d * d;
+}
+
+// Proper and touching crossings, collinear segments are left to the distance test
+static bool is_segments_intersect(const Vector2d& a, const Vector2d& b,
+  const Vector2d& c, const Vector2d& d)
+{
+  dim_t o1 = cross(b - a, c - a);
+  dim_t o2 = cross(b - a, d - a);
+  dim_t o3 = cross(d - c, a - c);
+  dim_t o4 = cross(d - c, b - c);
+  if (o1 == 0 && o2 == 0)
+    return false;
+
+  return (o1 <= 0 || o2 <= 0) && (o1 >= 0 || o2 >= 0)
+    && (o3 <= 0 || o4 <= 0) && (o3 >= 0 || o4 >= 0);
+}
+
+static bool is_inside(const Polygon& polygon, const Vector2d& p)
+{
+  bool negative = false;
+  bool positive = false;
+  for (size_t i = 0; i < polygon.size(); ++i)
+  {
+    const Vector2d& next = polygon[i + 1 == polygon.size() ? 0 : i + 1];
+    dim_t side = cross(next - polygon[i], p - polygon[i]);
+    negative = negative || side < 0;
+    positive = positive || side > 0;
+  }
+  return !(negative && positive);
+}
+
+bool Geometry::is_swept_circle_intersect(const Polygon& polygon,
+  const Vector2d& from, const Vector2d& to, dim_t r)
+{
+  if (polygon.empty())
+    return false;
+  if (is_inside(polygon, from))
+    return true;
+
+  // Otherwise the path crosses an edge or passes within r of one, and the
+  // distance between two segments that do not cross is reached at an endpoint
+  dim_t r_sq = r * r;
+  for (size_t i = 0; i < polygon.size(); ++i)
+  {
+    const Vector2d& a = polygon[i];
+    const Vector2d& b = polygon[i + 1 == polygon.size() ? 0 : i + 1];
+    if (is_segments_intersect(from, to, a, b)
+      || get_segment_distance_sq(a, from, to) <= r_sq
+      || get_segment_distance_sq(from, a, b) <= r_sq
+      || get_segment_distance_sq(to, a, b) <= r_sq)
+      return true;
+  }
+  return false;
 }
@@ -2,9 +2,105 @@
 #include "Engine.h"
 #include "Utility.h"
 #include <vector>
+#include <cstddef>
+#include <stdexcept>
 
 #define BORDER_CHECK(x, y) (x > 0 && x < SCREEN_WIDTH && y > 0 && y < SCREEN_HEIGHT)
 
+// Pixel rectangle [x0, x1) x [y0, y1) that drawing is restricted to, must lie within the screen
+struct ClipRect
+{
+  int x0 = 0;
+  int y0 = 0;
+  int x1 = SCREEN_WIDTH;
+  int y1 = SCREEN_HEIGHT;
+};
+
+// Horizontal run of pixels [x0, x1) in row y, relative to the origin of its mask
+struct Span
+{
+  int y;
+  int x0;
+  int x1;
+};
+
+// Pre-rasterized shape that is stamped by filling its spans
+struct SpanMask
+{
+  std::vector<Span> spans = {};
+  ClipRect bounds = { 0, 0, 0, 0 };   // Relative to the origin
+};
+
+// Fixed shapes that are rasterized once per size and stamped afterwards
+enum class StampShape
+{
+  Circle,     // Disc as drawn by draw_circle, origin at the floored centre
+};
+
+// Convex polygon with inline storage for a small number of vertices, so that
+// objects and collision tests need no heap memory
+class Polygon
+{
+public:
+  static const size_t max_vertices = 8;
+private:
+  Vector2d vertices_[max_vertices];
+  size_t size_ = 0;
+public:
+  void push_back(const Vector2d& vertex)
+  {
+    if (size_ == max_vertices)
+      throw std::length_error("Polygon capacity exceeded");
+
+    vertices_[size_++] = vertex;
+  }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  Vector2d* data() { return vertices_; }
+  const Vector2d* data() const { return vertices_; }
+  Vector2d* begin() { return vertices_; }
+  Vector2d* end() { return vertices_ + size_; }
+  const Vector2d* begin() const { return vertices_; }
+  const Vector2d* end() const { return vertices_ + size_; }
+  Vector2d& operator[](size_t i) { return vertices_[i]; }
+  const Vector2d& operator[](size_t i) const { return vertices_[i]; }
+  const Vector2d& front() const { return vertices_[0]; }
+  const Vector2d& back() const { return vertices_[size_ - 1]; }
+};
+
+// Quads stored as structure of arrays, get_x(k)[i] being the x of vertex k of
+// quad i, so that a polygon can be tested against several quads at once
+class QuadBatch
+{
+  std::vector<dim_t> x_[4];
+  std::vector<dim_t> y_[4];
+public:
+  void clear();
+  void reserve(size_t count);
+  void push_back(const Polygon& quad);
+  size_t size() const { return x_[0].size(); }
+  const dim_t* get_x(size_t k) const { return x_[k].data(); }
+  const dim_t* get_y(size_t k) const { return y_[k].data(); }
+};
+
+// Outline of a kind of object in model space, around the object's position,
+// shared by all objects of the kind. Side k runs from vertex k + 1 to vertex k,
+// the last one from the first vertex to the last, and is kept around its own
+// centre, so the pieces an object breaks into can share it too.
+class Shape
+{
+  Polygon outline_ = {};
+  Polygon sides_[Polygon::max_vertices];
+  Vector2d side_centres_[Polygon::max_vertices];
+public:
+  Shape() {}
+  explicit Shape(const Polygon& outline);
+  const Polygon& get_outline() const { return outline_; }
+  size_t get_side_count() const { return outline_.size(); }
+  const Polygon& get_side(size_t k) const { return sides_[k]; }
+  const Vector2d& get_side_centre(size_t k) const { return side_centres_[k]; }
+};
+
 enum COLOR
 {
   RED = 0xff0000,
@@ -28,20 +124,95 @@ class Geometry
 {
 public:
   static void draw_rectangle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-    const Vector2d& pos, dim_t hl, dim_t hw, float angle, uint32_t color);
+    const Vector2d& pos, dim_t hl, dim_t hw, float angle, uint32_t color,
+    const ClipRect& clip = ClipRect());
+  // Fills pixels [x0, x1) of row y, clipped to clip
+  static void draw_span(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+    int y, int x0, int x1, uint32_t color, const ClipRect& clip = ClipRect());
   static void draw_fill_rectangle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-    const Vector2d& pos, dim_t h, dim_t w, uint32_t color);
+    const Vector2d& pos, dim_t h, dim_t w, uint32_t color, const ClipRect& clip = ClipRect());
   static void draw_triangle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-      const Vector2d& pos, dim_t size, float angle, uint32_t color);
+      const Vector2d& pos, dim_t size, float angle, uint32_t color,
+      const ClipRect& clip = ClipRect());
   static void draw_circle(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-    const Vector2d& pos, dim_t r, uint32_t color);
+    const Vector2d& pos, dim_t r, uint32_t color, const ClipRect& clip = ClipRect());
   static void draw_line(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-      const Vector2d& pos1, const Vector2d& pos2, uint32_t color);
+      const Vector2d& pos1, const Vector2d& pos2, uint32_t color,
+      const ClipRect& clip = ClipRect());
   static void draw_digit(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-    const Vector2d& pos, uint32_t digit, dim_t size, uint32_t color);
+    const Vector2d& pos, uint32_t digit, dim_t size, uint32_t color,
+    const ClipRect& clip = ClipRect());
   static void draw_segment(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
-  const Vector2d& pos, DigitSegment segment, dim_t size, uint32_t color);
-  static Vector2d get_axis_projection(const std::vector<Vector2d>& vertices, const Vector2d& axis);
-  static bool is_intersect(const std::vector<Vector2d>& vertices1,
-    const std::vector<Vector2d>& vertices2);
+  const Vector2d& pos, DigitSegment segment, dim_t size, uint32_t color,
+  const ClipRect& clip = ClipRect());
+  static void draw_mask(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+    const SpanMask& mask, int x, int y, uint32_t color, const ClipRect& clip = ClipRect());
+  static void add_span(SpanMask& mask, const Span& span);
+  // Appends the set pixels of a width x height bitmap placed at (x, y) to mask
+  static void add_bitmap_spans(SpanMask& mask, const std::vector<uint8_t>& bitmap,
+    int width, int height, int x, int y);
+  // Cached masks below are built once per size, games on any thread may share them.
+  // Lookups take a lock, so callers drawing many keep the mask they got.
+  static const SpanMask& get_stamp(StampShape shape, int size);
+  // Digit as drawn by draw_digit at an integral position, rasterized once per size
+  static const SpanMask& get_digit_glyph(uint32_t digit, int size);
+  // Vertices of model turned by angle and placed at pos, with their bounding box
+  // (pos for an empty model). One sin/cos pair serves all vertices.
+  static void transform(const Polygon& model, const Vector2d& pos, float angle,
+    Polygon& world, Vector2d& min, Vector2d& max);
+  // Min and max of the vertices projected onto axis, which needs not be normalized
+  static Vector2d get_axis_projection(const Vector2d* vertices, size_t count, const Vector2d& axis);
+  // Separating axis test of two convex polygons. Triangles and quads go
+  // through the unrolled is_intersect<N1, N2>, other sizes through the loop.
+  static bool is_intersect(const Vector2d* vertices1, size_t count1,
+    const Vector2d* vertices2, size_t count2);
+  static bool is_intersect(const Polygon& polygon1, const Polygon& polygon2);
+  // result[i] = is_intersect(polygon, quad i), several quads per instruction where SIMD is available
+  static void intersect_batch(const Polygon& polygon, const QuadBatch& quads, uint8_t* result);
+  // Whether a circle of radius r moving from from to to touches the convex polygon
+  static bool is_swept_circle_intersect(const Polygon& polygon,
+    const Vector2d& from, const Vector2d& to, dim_t r);
+  template<size_t N1, size_t N2>
+  static bool is_intersect(const Vector2d* vertices1, const Vector2d* vertices2);
+private:
+  static bool has_separating_edge(const Vector2d* vertices1, size_t count1,
+    const Vector2d* vertices2, size_t count2);
 };
+
+// Projections are only compared with each other on the same axis, so the edge
+// normals are left unnormalized
+inline Vector2d Geometry::get_axis_projection(const Vector2d* vertices, size_t count,
+  const Vector2d& axis)
+{
+  dim_t min = vertices[0] * axis;
+  dim_t max = min;
+  for (size_t i = 1; i < count; ++i)
+  {
+    dim_t projection = vertices[i] * axis;
+    min = projection < min ? projection : min;
+    max = projection > max ? projection : max;
+  }
+  return { min, max };
+}
+
+inline bool Geometry::has_separating_edge(const Vector2d* vertices1, size_t count1,
+  const Vector2d* vertices2, size_t count2)
+{
+  for (size_t i = 0; i < count1; ++i)
+  {
+    const Vector2d& next = vertices1[i + 1 == count1 ? 0 : i + 1];
+    Vector2d axis = (next - vertices1[i]).get_norm();
+    Vector2d project1 = get_axis_projection(vertices1, count1, axis);
+    Vector2d project2 = get_axis_projection(vertices2, count2, axis);
+    if (project1.x > project2.y || project1.y < project2.x)
+      return true;
+  }
+  return false;
+}
+
+template<size_t N1, size_t N2>
+bool Geometry::is_intersect(const Vector2d* vertices1, const Vector2d* vertices2)
+{
+  return !has_separating_edge(vertices1, N1, vertices2, N2) &&
+    !has_separating_edge(vertices2, N2, vertices1, N1);
+}
@@ -0,0 +1,189 @@
+#include "JobSystem.h"
+
+// Worker index of the calling thread within the system it works for
+static thread_local const JobSystem* current_system = nullptr;
+static thread_local unsigned current_worker = 0;
+
+JobSystem::JobSystem()
+{
+  set_thread_count(1);
+}
+
+JobSystem::~JobSystem()
+{
+  stop_workers();
+}
+
+void JobSystem::set_thread_count(unsigned count)
+{
+  if (count == 0)
+    count = std::max(std::thread::hardware_concurrency(), 1u);
+  if (count == get_thread_count())
+    return;
+
+  stop_workers();
+  queues_.clear();
+  for (unsigned i = 0; i < count; ++i)
+  {
+    queues_.emplace_back(new Queue());
+    queues_.back()->jobs.resize(queue_capacity_);
+  }
+  for (unsigned i = 1; i < count; ++i)
+    workers_.emplace_back(&JobSystem::worker_loop, this, i);
+}
+
+void JobSystem::stop_workers()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+
+  workers_.clear();
+  stop_ = false;
+}
+
+unsigned JobSystem::get_worker() const
+{
+  return current_system == this ? current_worker : 0;
+}
+
+bool JobSystem::push(unsigned worker, const Job& job)
+{
+  Queue& queue = *queues_[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.count == queue_capacity_)
+    return false;
+
+  queue.jobs[(queue.first + queue.count) % queue_capacity_] = job;
+  ++queue.count;
+  return true;
+}
+
+bool JobSystem::pop(Queue& queue, bool newest, const JobCounter* counter, Job& job)
+{
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  for (size_t k = 0; k < queue.count; ++k)
+  {
+    size_t position = newest ? queue.count - 1 - k : k;
+    if (counter && queue.jobs[(queue.first + position) % queue_capacity_].counter != counter)
+      continue;
+
+    job = queue.jobs[(queue.first + position) % queue_capacity_];
+    // The gap closes towards the end the job was taken from, without a gap nothing moves
+    if (newest)
+    {
+      for (size_t m = position; m + 1 < queue.count; ++m)
+        queue.jobs[(queue.first + m) % queue_capacity_] = queue.jobs[(queue.first + m + 1) % queue_capacity_];
+    }
+    else
+    {
+      for (size_t m = position; m > 0; --m)
+        queue.jobs[(queue.first + m) % queue_capacity_] = queue.jobs[(queue.first + m - 1) % queue_capacity_];
+      queue.first = (queue.first + 1) % queue_capacity_;
+    }
+    --queue.count;
+    --queued_;
+    return true;
+  }
+  return false;
+}
+
+bool JobSystem::take(unsigned worker, const JobCounter* counter, Job& job)
+{
+  // Own jobs newest first, they are the most likely to be in cache
+  if (pop(*queues_[worker], true, counter, job))
+    return true;
+  // Oldest jobs of the others, the largest share of their work is left there
+  for (size_t k = 1; k < queues_.size(); ++k)
+  {
+    if (pop(*queues_[(worker + k) % queues_.size()], false, counter, job))
+      return true;
+  }
+  return false;
+}
+
+void JobSystem::execute(const Job& job, unsigned worker)
+{
+  job.function(job.data, job.begin, job.end, worker);
+  if (job.counter->pending.fetch_sub(1, std::memory_order_release) == 1)
+  {
+    // A thread in wait() either sees the counter at 0 or sleeps already
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    wait_cv_.notify_all();
+  }
+}
+
+void JobSystem::wake()
+{
+  // A thread that found nothing to do either still sees the job or sleeps already
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  sleep_cv_.notify_one();
+  wait_cv_.notify_all();
+}
+
+void JobSystem::submit(Function function, void* data, size_t begin, size_t end, JobCounter& counter)
+{
+  Job job = { function, data, begin, end, &counter };
+  unsigned worker = get_worker();
+  counter.pending.fetch_add(1, std::memory_order_relaxed);
+  // Counted before it is queued, so that a sleeping worker cannot miss it
+  ++queued_;
+  ++submitted_;
+  if (!push(worker, job))
+  {
+    --queued_;
+    execute(job, worker);
+    return;
+  }
+  wake();
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+  unsigned worker = get_worker();
+  while (counter.pending.load(std::memory_order_acquire) > 0)
+  {
+    // Jobs of the counter may be submitted by the ones running elsewhere
+    uint64_t submitted = submitted_;
+    Job job;
+    if (take(worker, &counter, job))
+    {
+      execute(job, worker);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wait_cv_.wait(lock, [&]()
+    {
+      return counter.pending.load(std::memory_order_acquire) == 0 || submitted_ != submitted;
+    });
+  }
+}
+
+void JobSystem::worker_loop(unsigned worker)
+{
+  current_system = this;
+  current_worker = worker;
+  for (;;)
+  {
+    Job job;
+    if (take(worker, nullptr, job))
+    {
+      execute(job, worker);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.wait(lock, [&]() { return stop_ || queued_ > 0; });
+    if (stop_)
+      return;
+  }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdexcept>
+
+// Jobs submitted and not finished yet, JobSystem::wait() returns when it drops to 0
+struct JobCounter
+{
+  std::atomic<size_t> pending = { 0 };
+};
+
+// Threads shared by all subsystems that run work in parallel. Every thread has
+// a queue of jobs: it takes its own newest job first and, when the queue is
+// empty, steals the oldest job of another thread. Waiting for a counter runs
+// the jobs of that counter meanwhile, and only those, so jobs may submit and
+// wait for jobs of their own without picking up unrelated long jobs.
+// Threads that are not workers, such as the main thread, share queue 0 and
+// count as worker 0, so only one of them should use the system at a time.
+// Queues are fixed in size, a job that does not fit runs at once; nothing is
+// allocated after set_thread_count(). Jobs must not throw.
+class JobSystem
+{
+public:
+  typedef void (*Function)(void* data, size_t begin, size_t end, unsigned worker);
+private:
+  struct Job
+  {
+    Function function;
+    void* data;
+    size_t begin;
+    size_t end;
+    JobCounter* counter;
+  };
+  struct Queue
+  {
+    std::mutex mutex;
+    std::vector<Job> jobs;    // Ring buffer
+    size_t first = 0;
+    size_t count = 0;
+  };
+  static const size_t queue_capacity_ = 1024;
+
+  std::vector<std::unique_ptr<Queue>> queues_ = {};   // By worker
+  std::vector<std::thread> workers_ = {};
+  std::atomic<size_t> queued_ = { 0 };    // Jobs in all queues, may run ahead of them
+  std::atomic<uint64_t> submitted_ = { 0 };
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;      // Idle workers
+  std::condition_variable wait_cv_;       // Threads in wait() with no job of their counter to run
+  bool stop_ = false;
+
+  template<typename F>
+  static void call(void* body, size_t begin, size_t end, unsigned worker)
+  {
+    (*static_cast<const F*>(body))(begin, end, worker);
+  }
+  bool push(unsigned worker, const Job& job);
+  // Removes the newest or oldest job of counter from queue, any job if counter is null
+  bool pop(Queue& queue, bool newest, const JobCounter* counter, Job& job);
+  bool take(unsigned worker, const JobCounter* counter, Job& job);
+  void execute(const Job& job, unsigned worker);
+  void wake();
+  void worker_loop(unsigned worker);
+  void stop_workers();
+public:
+  JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+  ~JobSystem();
+
+  // 1 - every job runs on the thread that waits for it, 0 - one thread per core.
+  // No jobs may be pending.
+  void set_thread_count(unsigned count);
+  unsigned get_thread_count() const { return unsigned(queues_.size()); }
+  // Index of the calling thread below get_thread_count(), 0 for other threads
+  unsigned get_worker() const;
+
+  // Queues function(data, begin, end, worker) and adds it to counter
+  void submit(Function function, void* data, size_t begin, size_t end, JobCounter& counter);
+  // Runs jobs of counter until it drops to 0, sleeps while others run the rest
+  void wait(JobCounter& counter);
+
+  // Calls body(begin, end, worker) for the chunks [k * chunk_size, (k + 1) * chunk_size)
+  // of [0, count) and returns when all are done. Chunks do not depend on the thread
+  // count; worker tells the thread running a chunk, for its scratch data.
+  template<typename F>
+  void parallel_for(size_t count, size_t chunk_size, const F& body)
+  {
+    if (chunk_size == 0)
+      throw std::invalid_argument("JobSystem chunk size must not be 0");
+    if (get_thread_count() == 1 || count <= chunk_size)
+    {
+      unsigned worker = get_worker();
+      for (size_t begin = 0; begin < count; begin += chunk_size)
+        body(begin, std::min(begin + chunk_size, count), worker);
+      return;
+    }
+
+    JobCounter counter;
+    for (size_t begin = 0; begin < count; begin += chunk_size)
+      submit(&call<F>, const_cast<F*>(&body), begin, std::min(begin + chunk_size, count), counter);
+    wait(counter);
+  }
+  static size_t get_chunk_count(size_t count, size_t chunk_size)
+  {
+    return (count + chunk_size - 1) / chunk_size;
+  }
+};
@@ -1,6 +1,10 @@
 #include "Objects.h"
 #include "Geometry.h"
 #include <algorithm>
+#include <atomic>
+
+static std::atomic<uint64_t> collision_tests = { 0 };
+static std::atomic<uint64_t> collision_sat_tests = { 0 };
 
 Vector2d Object2d::get_position() const
 {
@@ -19,10 +23,8 @@ float Object2d::get_angle() const
 
 void Object2d::set_position(const Vector2d& pos)
 {
-  Vector2d r = pos - pos_;
   pos_ = pos;
-  std::transform(vertices_.begin(), vertices_.end(), vertices_.begin(),
-    [&](Vector2d& v) { return v + r; });
+  transformed_ = false;
 }
 
 void Object2d::set_velocity(const Vector2d& vel)
@@ -33,11 +35,40 @@ void Object2d::set_velocity(const Vector2d& vel)
 void Object2d::set_angle(float angle)
 {
   angle_ = angle;
+  transformed_ = false;
 }
 
 bool Object2d::is_intersect(const Object2d& object) const
 {
-  return Geometry::is_intersect(vertices_, object.vertices_);
+  update_transform();
+  object.update_transform();
+  return is_intersect(vertices_, bounds_min_, bounds_max_,
+    object.vertices_, object.bounds_min_, object.bounds_max_);
+}
+
+bool Object2d::is_intersect(const Polygon& vertices1, const Vector2d& min1, const Vector2d& max1,
+  const Polygon& vertices2, const Vector2d& min2, const Vector2d& max2)
+{
+  collision_tests.fetch_add(1, std::memory_order_relaxed);
+  if (min1.x > max2.x || max1.x < min2.x || min1.y > max2.y || max1.y < min2.y)
+    return false;
+
+  collision_sat_tests.fetch_add(1, std::memory_order_relaxed);
+  return Geometry::is_intersect(vertices1, vertices2);
+}
+
+CollisionStats Object2d::get_collision_stats()
+{
+  CollisionStats stats;
+  stats.tests = collision_tests.load(std::memory_order_relaxed);
+  stats.sat_tests = collision_sat_tests.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Object2d::reset_collision_stats()
+{
+  collision_tests = 0;
+  collision_sat_tests = 0;
 }
 
 void Object2d::set_color(uint32_t color)
@@ -55,39 +86,74 @@ uint32_t Object2d::get_color() const
   return color_;
 }
 
-void Object2d::add_vertex(const Vector2d& vertex)
+void Object2d::set_shape(const std::shared_ptr<const Shape>& shape)
 {
-  vertices_.push_back(vertex);
+  shape_ = shape;
+  transformed_ = false;
 }
 
-void Object2d::draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const
+void Object2d::draw(RenderQueue& queue) const
 {
-  for (size_t i = 1; i < vertices_.size(); ++i)
-    Geometry::draw_line(buffer, vertices_[i - 1], vertices_[i], color_);
-
-  Geometry::draw_line(buffer, vertices_.front(), vertices_.back(), color_);
+  queue.add_outline(get_vertices(), color_);
 }
 
 void Object2d::rotate(const Vector2d& r, float angle)
 {
+  pos_ = pos_.rotate(r, angle);
   angle_ += angle;
-  std::transform(vertices_.begin(), vertices_.end(), vertices_.begin(),
-    [&](Vector2d& v) { return v.rotate(r, angle); });
+  transformed_ = false;
 }
 
 void Object2d::update(float dt)
 {
-  Vector2d vel = get_velocity();
-  Vector2d pos = get_position();
-  rotate(pos, dt * rotate_speed_);
-  set_position({ pos.x + dt * vel.x, pos.y + dt * vel.y });
+  angle_ += dt * rotate_speed_;
+  pos_ = { pos_.x + dt * vel_.x, pos_.y + dt * vel_.y };
+  transformed_ = false;
 }
 
-const std::vector<Vector2d>& Object2d::get_vertices() const
+const std::shared_ptr<const Shape>& Object2d::get_shape() const
 {
+  return shape_;
+}
+
+const Polygon& Object2d::get_vertices() const
+{
+  update_transform();
   return vertices_;
 }
 
+void Object2d::get_bounds(Vector2d& min, Vector2d& max) const
+{
+  update_transform();
+  min = bounds_min_;
+  max = bounds_max_;
+}
+
+void Object2d::update_transform() const
+{
+  if (transformed_)
+    return;
+
+  static const Polygon no_vertices;
+  Geometry::transform(shape_ ? shape_->get_outline() : no_vertices, pos_, angle_,
+    vertices_, bounds_min_, bounds_max_);
+  transformed_ = true;
+}
+
+void Object2d::interpolate_vertices(float t, Polygon& vertices) const
+{
+  static const Polygon no_vertices;
+  Vector2d min, max;
+  Geometry::transform(shape_ ? shape_->get_outline() : no_vertices, lerp(prev_pos_, pos_, t),
+    lerp_angle(prev_angle_, angle_, t), vertices, min, max);
+}
+
+void Object2d::save_previous()
+{
+  prev_pos_ = pos_;
+  prev_angle_ = angle_;
+}
+
 float Object2d::get_rotate_speed() const
 {
   return rotate_speed_;
@@ -100,26 +166,12 @@ void GameObject2d::update(float dt)
   dim_t decay = vel.get_magnitude() - dt * vel_decay_;
   Vector2d norm = vel.get_normalized();
   set_velocity({ norm.x * decay, norm.y * decay });
-  if (!effects_.empty())
-  {
-    for (auto& e : effects_)
-    {
-      e.update(dt);
-      if (e.is_ready())
-        e.apply_effect();
-    }
-    auto fresh_eff_end = std::remove_if(effects_.begin(), effects_.end(),
-      [&](Effect& e) { return e.is_ready(); });
-    effects_.erase(fresh_eff_end, effects_.end());
-    auto c = effects_.size();
-  }
 }
 
 void GameObject2d::reset()
 {
   set_color(COLOR::WHITE);
   set_rotate_speed(0);
-  effects_.clear();
 }
 
 void GameObject2d::set_health(health_t health)
@@ -162,19 +214,16 @@ void GameObject2d::set_active(bool active)
   active_ = active;
 }
 
-void GameObject2d::add_effect(float delay, const std::function<void()>& effect)
-{
-  effects_.emplace_back(delay, effect);
-}
-
 Player::Player(const Vector2d& pos, const Vector2d& vel, health_t health)
   : GameObject2d(pos, vel, health, 0, true)
 {
   dim_t size = 50;
   float R = size / sqrt(3);
-  add_vertex({ pos.x, pos.y - R });
-  add_vertex({ pos.x + size / 2, pos.y + R / 2 });
-  add_vertex({ pos.x - size / 2, pos.y + R / 2 });
+  Polygon outline;
+  outline.push_back({ 0, -R });
+  outline.push_back({ size / 2, R / 2 });
+  outline.push_back({ -size / 2, R / 2 });
+  set_shape(std::make_shared<Shape>(outline));
 }
 
 void Player::set_god_mode(bool god_mode)
@@ -206,127 +255,85 @@ void Player::update(float dt)
   GameObject2d::update(dt);
 }
 
-void Projectile::draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const
-{
-  Geometry::draw_circle(buffer, get_position(), 5, get_color());
-}
-
-Enemy::Enemy()
-{
-  init_vertices();
-}
-
-Enemy::Enemy(const Vector2d& pos, const Vector2d& vel,
-  health_t health, health_t damage, bool active)
-  : GameObject2d(pos, vel, health, damage, active)
+void Score::draw(RenderQueue& queue) const
 {
-  init_vertices();
-}
-
-void Enemy::init_vertices()
-{
-  dim_t size = 15;
-  Vector2d pos = get_position();
-  add_vertex({ pos.x - size, pos.y - size });
-  add_vertex({ pos.x + size, pos.y - size });
-  add_vertex({ pos.x + size, pos.y + size });
-  add_vertex({ pos.x - size, pos.y + size });
-}
-
-void Enemy::update(float dt)
-{
-  GameObject2d::update(dt);
   Vector2d pos = get_position();
-  if (!BORDER_CHECK(pos.x, pos.y))
-    set_active(false);
-}
-
-Projectile::Projectile()
-{
-  affected_enemies_.reserve(10);
-  init_vertices();
-}
-
-Projectile::Projectile(const Vector2d& pos, const Vector2d& vel,
-  health_t health, health_t damage, bool active)
-  : GameObject2d(pos, vel, health, damage, active)
-{
-  affected_enemies_.reserve(10);
-  init_vertices();
-}
-
-void Projectile::init_vertices()
-{
-  dim_t size = 5;
-  Vector2d pos = get_position();
-  add_vertex({ pos.x - size, pos.y - size });
-  add_vertex({ pos.x + size, pos.y - size });
-  add_vertex({ pos.x + size, pos.y + size });
-  add_vertex({ pos.x - size, pos.y + size });
-}
-
-void Projectile::update(float dt)
-{
-  GameObject2d::update(dt);
-  Vector2d pos = get_position();
-  if (!BORDER_CHECK(pos.x, pos.y))
-    set_active(false);
-}
-
-void Projectile::reset()
-{
-  clear_affected_enemies();
-}
+  if (text_ && pos.x == floor(pos.x) && pos.y == floor(pos.y))
+  {
+    queue.add_mask(text_, int(pos.x), int(pos.y), get_color());
+    return;
+  }
 
-void Projectile::add_affected_enemy(const Enemy& enemy)
-{
-  affected_enemies_.push_back(&enemy);
+  uint32_t factor = 1;
+  uint32_t i = 0;
+  do
+  {
+    uint32_t digit = score_ % (factor * 10) / factor;
+    queue.add_digit({ dim_t(pos.x - 1.5 * size_ * i++), pos.y }, digit, size_, get_color());
+    factor *= 10;
+  } while (score_ / factor != 0);
 }
 
-void Projectile::clear_affected_enemies()
+void Score::set_score(uint32_t score)
 {
-  affected_enemies_.clear();
-}
+  if (score == score_ && text_)
+    return;
 
-bool Projectile::is_enemy_affected(const Enemy& enemy) const
-{
-  return std::any_of(affected_enemies_.cbegin(), affected_enemies_.cend(),
-    [&](const Enemy* e) { return e == &enemy; });
+  score_ = score;
+  update_text();
 }
 
-
-void Effect::update(float dt)
+void Score::update_text()
 {
-  timer_ += dt;
-}
+  // Queues recorded earlier may still reference the old mask, so the text is
+  // built in a mask of the pool nothing else holds, or in a new one
+  text_ = nullptr;
+  if (size_ != floor(size_) || size_ < 0 || size_ >= 1 << 12)
+    return;
 
-bool Effect::is_ready() const
-{
-  return timer_ >= delay_;
-}
+  if (text_pool_.empty())
+  {
+    // One mask for the text and one for each queue that may still be drawing
+    // an older one, large enough for six digits
+    size_t spans = 6 * Geometry::get_digit_glyph(8, int(size_)).spans.size();
+    for (int i = 0; i < 3; ++i)
+    {
+      text_pool_.push_back(std::make_shared<SpanMask>());
+      text_pool_.back()->spans.reserve(spans);
+    }
+  }
 
-void Effect::apply_effect() const
-{
-  effect_();
-}
+  std::shared_ptr<SpanMask> text = nullptr;
+  for (const auto& mask : text_pool_)
+  {
+    if (mask.use_count() == 1)
+    {
+      text = mask;
+      break;
+    }
+  }
+  if (text)
+  {
+    text->spans.clear();
+    text->bounds = { 0, 0, 0, 0 };
+  }
+  else
+  {
+    text = std::make_shared<SpanMask>();
+    text_pool_.push_back(text);
+  }
 
-void Score::draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const
-{
-  uint32_t factor = 1;
+  uint32_t value = score_;
   uint32_t i = 0;
-  Vector2d pos = get_position();
   do
   {
-    uint32_t digit = score_ % (factor * 10) / factor;
-    Geometry::draw_digit(buffer, { dim_t(pos.x - 1.5 * size_ * i++), pos.y },
-      digit, size_, get_color());
-    factor *= 10;
-  } while (score_ / factor != 0);
-}
-
-void Score::set_score(uint32_t score)
-{
-  score_ = score;
+    const SpanMask& glyph = Geometry::get_digit_glyph(value % 10, int(size_));
+    int offset = int(floor(-1.5 * size_ * i++));
+    for (const auto& span : glyph.spans)
+      Geometry::add_span(*text, { span.y, span.x0 + offset, span.x1 + offset });
+    value /= 10;
+  } while (value != 0);
+  text_ = text;
 }
 
 uint32_t Score::get_score() const
@@ -2,12 +2,24 @@
 #include "Utility.h"
 #include "Engine.h"
 #include "Geometry.h"
+#include "Renderer.h"
 #include <vector>
-#include <functional>
-#include <list>
+#include <memory>
 
 typedef int health_t;
 
+// Counters of Object2d::is_intersect since the last reset, and of the projectile
+// paths Game tested against enemies
+struct CollisionStats
+{
+  uint64_t tests = 0;             // Pairs tested
+  uint64_t sat_tests = 0;         // Pairs whose bounds overlapped and went through SAT
+  uint64_t grid_candidates = 0;   // Enemies sharing a grid cell with a projectile path
+  uint64_t bounds_rejects = 0;    // Candidates whose bounds missed the path
+  uint64_t batch_lanes = 0;       // Candidates tested in SAT batches
+  uint64_t swept_tests = 0;       // Candidates the batch missed, tested along the path
+};
+
 class Object2d
 {
   Vector2d pos_ = { 0, 0 };
@@ -15,12 +27,22 @@ class Object2d
   float angle_ = 0;
   float rotate_speed_ = 0;
   uint32_t color_ = COLOR::WHITE;
-  std::vector<Vector2d> vertices_ = {};   // Vertices of geometric figure
+  std::shared_ptr<const Shape> shape_ = nullptr;   // Model space, shared with other objects of the kind
+  Vector2d prev_pos_ = { 0, 0 };   // Pose at the start of the tick, for drawing between ticks
+  float prev_angle_ = 0;
+  // World vertices of shape_ and their bounding box, computed when asked for after a move
+  mutable Polygon vertices_ = {};
+  mutable Vector2d bounds_min_ = { 0, 0 };
+  mutable Vector2d bounds_max_ = { 0, 0 };
+  mutable bool transformed_ = false;
+  void update_transform() const;
 public:
   Object2d() {}
-  Object2d(const Vector2d& pos, const Vector2d& vel) : pos_(pos), vel_(vel) {}
+  Object2d(const Vector2d& pos, const Vector2d& vel)
+    : pos_(pos), vel_(vel), prev_pos_(pos)
+  {}
 
-  virtual void draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const;
+  virtual void draw(RenderQueue& queue) const;
   virtual void update(float dt);
   virtual void reset() {}
 
@@ -29,7 +51,7 @@ public:
   void set_angle(float angle);
   void set_color(uint32_t color);
   void set_rotate_speed(float speed);
-  void add_vertex(const Vector2d& vertex);
+  void set_shape(const std::shared_ptr<const Shape>& shape);
   void rotate(const Vector2d& r, float angle);
 
   Vector2d get_position() const;
@@ -37,40 +59,37 @@ public:
   float get_angle() const;
   uint32_t get_color() const;
   float get_rotate_speed() const;
-  const std::vector<Vector2d>& get_vertices() const;
-
+  const std::shared_ptr<const Shape>& get_shape() const;
+  const Polygon& get_vertices() const;
+  void get_bounds(Vector2d& min, Vector2d& max) const;
+  // World vertices a fraction t of the way from the previous pose to the current one,
+  // not cached
+  void interpolate_vertices(float t, Polygon& vertices) const;
+  // Makes the current pose the previous one, at the start of a tick
+  void save_previous();
+
+  // Bounding boxes are compared first, SAT runs only when they overlap
   bool is_intersect(const Object2d& object) const;
+  static bool is_intersect(const Polygon& vertices1, const Vector2d& min1, const Vector2d& max1,
+    const Polygon& vertices2, const Vector2d& min2, const Vector2d& max2);
+  static CollisionStats get_collision_stats();
+  static void reset_collision_stats();
   virtual ~Object2d() {};
 };
 
-class Effect
-{
-  float delay_ = 0;
-  float timer_ = 0;
-  std::function<void()> effect_;
-public:
-  Effect(float delay, const std::function<void()>& effect)
-    : delay_(delay), effect_(effect)
-  {}
-  void update(float dt);
-  void apply_effect() const;
-  bool is_ready() const;
-};
-
 class GameObject2d : public Object2d
 {
   health_t health_ = 0;
   float vel_decay_ = 0;
   bool active_ = false;
   health_t damage_ = 0;
-  std::list<Effect> effects_ = {};
 public:
   GameObject2d() {}
   GameObject2d(const Vector2d& pos, const Vector2d& vel, health_t health, health_t damage, bool active)
     : Object2d(pos, vel), health_(health), active_(active), damage_(damage)
   {}
 
-  //virtual void draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const override {};
+  //virtual void draw(RenderQueue& queue) const override {};
   virtual void update(float dt) override;
   virtual void reset() override;
 
@@ -78,7 +97,6 @@ public:
   void set_active(bool active);
   void set_health(health_t health);
   void set_damage(health_t damage);
-  void add_effect(float delay, const std::function<void()>& effect);
 
   health_t get_health() const;
   health_t get_damage() const;
@@ -98,38 +116,16 @@ public:
   bool is_damageable() const;
 };
 
-class Enemy : public GameObject2d
-{
-  void init_vertices();
-public:
-  Enemy();
-  Enemy(const Vector2d& pos, const Vector2d& vel, health_t health, health_t damage, bool active);
-  void update(float dt) override;
-};
-
-class Projectile : public GameObject2d
-{
-  std::vector<const Enemy*> affected_enemies_ = std::vector<const Enemy*>();
-  void init_vertices();
-public:
-  Projectile();
-  Projectile(const Vector2d& pos, const Vector2d& vel, health_t health, health_t damage, bool active);
-
-  void draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const override;
-  void reset() override;
-  void update(float dt) override;
-  void add_affected_enemy(const Enemy& enemy);
-  void clear_affected_enemies();
-  bool is_enemy_affected(const Enemy& enemy) const;
-};
-
 class Score : public Object2d
 {
   uint32_t score_ = 0;
   dim_t size_ = 20;
+  std::shared_ptr<const SpanMask> text_ = nullptr;  // All digits of score_ relative to an integral position
+  std::vector<std::shared_ptr<SpanMask>> text_pool_ = {};   // Masks text_ was built in
+  void update_text();
 public:
-  Score(const Vector2d& pos, uint32_t size) : Object2d(pos, { 0, 0 }), size_(size) {}
-  virtual void draw(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]) const override;
+  Score(const Vector2d& pos, uint32_t size) : Object2d(pos, { 0, 0 }), size_(size) { update_text(); }
+  virtual void draw(RenderQueue& queue) const override;
   virtual void update(float dt) override {}
 
   void set_score(uint32_t score);
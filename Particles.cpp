@@ -0,0 +1,127 @@
+#include "Particles.h"
+#include "FastMath.h"
+#include <cmath>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLES_SSE2
+#endif
+
+ParticleSystem::ParticleSystem(size_t capacity)
+  : capacity_(capacity),
+  x_(capacity), y_(capacity), vel_x_(capacity), vel_y_(capacity),
+  half_x_(capacity), half_y_(capacity), angle_(capacity), rotate_speed_(capacity), life_(capacity)
+{}
+
+bool ParticleSystem::emit(const Vector2d& centre, const Vector2d& half, float angle,
+  const Vector2d& vel, float rotate_speed, float life_time)
+{
+  if (count_ == capacity_)
+    return false;
+
+  size_t i = count_++;
+  x_[i] = centre.x;
+  y_[i] = centre.y;
+  vel_x_[i] = vel.x;
+  vel_y_[i] = vel.y;
+  half_x_[i] = half.x;
+  half_y_[i] = half.y;
+  angle_[i] = angle;
+  rotate_speed_[i] = rotate_speed;
+  life_[i] = life_time;
+  return true;
+}
+
+// value[i] += dt * rate[i]; multiplication and addition stay separate, so the
+// SIMD and scalar parts round alike
+static void add_scaled(float* value, const float* rate, float dt, size_t count)
+{
+  size_t i = 0;
+#if defined(PARTICLES_SSE2)
+  __m128 t = _mm_set1_ps(dt);
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_ps(value + i, _mm_add_ps(_mm_loadu_ps(value + i), _mm_mul_ps(t, _mm_loadu_ps(rate + i))));
+#endif
+  for (; i < count; ++i)
+    value[i] += dt * rate[i];
+}
+
+static void subtract(float* value, float dt, size_t count)
+{
+  size_t i = 0;
+#if defined(PARTICLES_SSE2)
+  __m128 t = _mm_set1_ps(dt);
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_ps(value + i, _mm_sub_ps(_mm_loadu_ps(value + i), t));
+#endif
+  for (; i < count; ++i)
+    value[i] -= dt;
+}
+
+void ParticleSystem::update(float dt)
+{
+  integrate(dt, 0, count_);
+  remove_expired();
+}
+
+void ParticleSystem::integrate(float dt, size_t begin, size_t end)
+{
+  end = std::min(end, count_);
+  if (begin >= end)
+    return;
+
+  size_t count = end - begin;
+  add_scaled(x_.data() + begin, vel_x_.data() + begin, dt, count);
+  add_scaled(y_.data() + begin, vel_y_.data() + begin, dt, count);
+  add_scaled(angle_.data() + begin, rotate_speed_.data() + begin, dt, count);
+  subtract(life_.data() + begin, dt, count);
+}
+
+void ParticleSystem::remove_expired()
+{
+  size_t count = 0;
+  for (size_t i = 0; i < count_; ++i)
+  {
+    if (!(life_[i] > 0))
+      continue;
+
+    if (i != count)
+    {
+      x_[count] = x_[i];
+      y_[count] = y_[i];
+      vel_x_[count] = vel_x_[i];
+      vel_y_[count] = vel_y_[i];
+      half_x_[count] = half_x_[i];
+      half_y_[count] = half_y_[i];
+      angle_[count] = angle_[i];
+      rotate_speed_[count] = rotate_speed_[i];
+      life_[count] = life_[i];
+    }
+    ++count;
+  }
+  count_ = count;
+}
+
+void ParticleSystem::draw(RenderQueue& queue, float rewind) const
+{
+  queue.begin_lines(color_);
+  for (size_t i = count_; i-- > 0;)
+  {
+    float s, c;
+    fast_sin_cos(angle_[i] - rewind * rotate_speed_[i], s, c);
+    Vector2d half = { half_x_[i] * c - half_y_[i] * s, half_x_[i] * s + half_y_[i] * c };
+    Vector2d centre = { x_[i] - rewind * vel_x_[i], y_[i] - rewind * vel_y_[i] };
+    queue.add_batch_line(centre + half, centre - half);
+  }
+  queue.end_lines();
+}
+
+void ParticleSystem::clear()
+{
+  count_ = 0;
+}
+
+void ParticleSystem::set_color(uint32_t color)
+{
+  color_ = color;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "Engine.h"
+#include "Utility.h"
+#include "Geometry.h"
+#include "Renderer.h"
+#include <cstddef>
+#include <vector>
+
+// Line segment particles, e.g. the pieces of destroyed objects. Storage is
+// allocated once for capacity particles as structure of arrays, so emitting
+// and updating never allocate and update() integrates several particles per
+// instruction where SIMD is available. Particles are kept oldest first and
+// expire when their life runs out; emitting into a full system drops the new
+// particle.
+class ParticleSystem
+{
+  size_t capacity_ = 0;
+  size_t count_ = 0;
+  uint32_t color_ = COLOR::WHITE;
+  std::vector<float> x_ = {};         // Centre
+  std::vector<float> y_ = {};
+  std::vector<float> vel_x_ = {};
+  std::vector<float> vel_y_ = {};
+  std::vector<float> half_x_ = {};    // From the centre to an end, before rotation by angle
+  std::vector<float> half_y_ = {};
+  std::vector<float> angle_ = {};
+  std::vector<float> rotate_speed_ = {};
+  std::vector<float> life_ = {};      // Seconds left
+public:
+  explicit ParticleSystem(size_t capacity);
+
+  // Segment from centre + half to centre - half, both turned by angle around centre
+  bool emit(const Vector2d& centre, const Vector2d& half, float angle,
+    const Vector2d& vel, float rotate_speed, float life_time);
+  // Moves and rotates all particles, then removes the expired ones keeping the order
+  void update(float dt);
+  // The two steps of update(), integration of particles [begin, end) can run
+  // on several threads for ranges that do not overlap
+  void integrate(float dt, size_t begin, size_t end);
+  void remove_expired();
+  // Newest first, one line per particle, as it was rewind seconds ago. Particles
+  // move linearly, so this is where they were between the last two updates.
+  void draw(RenderQueue& queue, float rewind = 0) const;
+  void clear();
+
+  void set_color(uint32_t color);
+  size_t size() const { return count_; }
+  size_t get_capacity() const { return capacity_; }
+};
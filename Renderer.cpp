@@ -0,0 +1,484 @@
+#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+// Pixel coordinate of v clamped to [lo, hi], NaN goes to lo
+static int clamp_pixel(dim_t v, int lo, int hi)
+{
+  if (!(v >= lo))
+    return lo;
+  if (v >= hi)
+    return hi;
+  return int(floor(v));
+}
+
+void DrawCommand::execute(const RenderQueue& queue, uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+  const ClipRect& clip) const
+{
+  switch (type)
+  {
+  case DrawCommandType::Line:
+    Geometry::draw_line(buffer, pos1, pos2, color, clip);
+    break;
+  case DrawCommandType::FillRectangle:
+    Geometry::draw_fill_rectangle(buffer, pos1, pos2.y, pos2.x, color, clip);
+    break;
+  case DrawCommandType::Circle:
+    Geometry::draw_circle(buffer, pos1, size, color, clip);
+    break;
+  case DrawCommandType::Digit:
+    Geometry::draw_digit(buffer, pos1, digit, size, color, clip);
+    break;
+  case DrawCommandType::Mask:
+    Geometry::draw_mask(buffer, *mask, int(pos1.x), int(pos1.y), color, clip);
+    break;
+  case DrawCommandType::Lines:
+  {
+    const Vector2d* ends = queue.get_line_ends() + 2 * first_line;
+    for (uint32_t i = 0; i < line_count; ++i)
+      Geometry::draw_line(buffer, ends[2 * i], ends[2 * i + 1], color, clip);
+    break;
+  }
+  }
+}
+
+void RenderQueue::add(DrawCommand& command, dim_t min_x, dim_t min_y, dim_t max_x, dim_t max_y)
+{
+  command.bounds.x0 = clamp_pixel(min_x, 0, SCREEN_WIDTH);
+  command.bounds.y0 = clamp_pixel(min_y, 0, SCREEN_HEIGHT);
+  command.bounds.x1 = clamp_pixel(floor(max_x) + 1, 0, SCREEN_WIDTH);
+  command.bounds.y1 = clamp_pixel(floor(max_y) + 1, 0, SCREEN_HEIGHT);
+  if (command.bounds.x0 < command.bounds.x1 && command.bounds.y0 < command.bounds.y1)
+    commands_.push_back(command);
+}
+
+void RenderQueue::clear()
+{
+  commands_.clear();
+  masks_.clear();
+  line_ends_.clear();
+}
+
+void RenderQueue::reserve(size_t count)
+{
+  commands_.reserve(count);
+  line_ends_.reserve(2 * count);
+}
+
+void RenderQueue::add_line(const Vector2d& pos1, const Vector2d& pos2, uint32_t color)
+{
+  DrawCommand command;
+  command.type = DrawCommandType::Line;
+  command.pos1 = pos1;
+  command.pos2 = pos2;
+  command.color = color;
+  add(command, std::min(pos1.x, pos2.x), std::min(pos1.y, pos2.y),
+    std::max(pos1.x, pos2.x), std::max(pos1.y, pos2.y));
+}
+
+void RenderQueue::begin_lines(uint32_t color)
+{
+  batch_ = DrawCommand();
+  batch_.type = DrawCommandType::Lines;
+  batch_.first_line = uint32_t(line_ends_.size() / 2);
+  batch_.color = color;
+}
+
+void RenderQueue::add_batch_line(const Vector2d& pos1, const Vector2d& pos2)
+{
+  Vector2d min = { std::min(pos1.x, pos2.x), std::min(pos1.y, pos2.y) };
+  Vector2d max = { std::max(pos1.x, pos2.x), std::max(pos1.y, pos2.y) };
+  if (batch_.line_count > 0)
+  {
+    min = { std::min(min.x, batch_min_.x), std::min(min.y, batch_min_.y) };
+    max = { std::max(max.x, batch_max_.x), std::max(max.y, batch_max_.y) };
+    // A batch is drawn by every tile its bounds touch, so it is kept small
+    if (batch_.line_count == max_batch_lines_
+      || max.x - min.x > max_batch_extent_ || max.y - min.y > max_batch_extent_)
+    {
+      flush_lines();
+      min = { std::min(pos1.x, pos2.x), std::min(pos1.y, pos2.y) };
+      max = { std::max(pos1.x, pos2.x), std::max(pos1.y, pos2.y) };
+    }
+  }
+  batch_min_ = min;
+  batch_max_ = max;
+  line_ends_.push_back(pos1);
+  line_ends_.push_back(pos2);
+  ++batch_.line_count;
+}
+
+void RenderQueue::end_lines()
+{
+  flush_lines();
+}
+
+void RenderQueue::flush_lines()
+{
+  if (batch_.line_count > 0)
+    add(batch_, batch_min_.x, batch_min_.y, batch_max_.x, batch_max_.y);
+  batch_.first_line = uint32_t(line_ends_.size() / 2);
+  batch_.line_count = 0;
+}
+
+void RenderQueue::add_outline(const Polygon& polygon, uint32_t color)
+{
+  if (polygon.empty())
+    return;
+
+  for (size_t i = 1; i < polygon.size(); ++i)
+    add_line(polygon[i - 1], polygon[i], color);
+
+  add_line(polygon.front(), polygon.back(), color);
+}
+
+void RenderQueue::add_fill_rectangle(const Vector2d& pos, dim_t h, dim_t w, uint32_t color)
+{
+  DrawCommand command;
+  command.type = DrawCommandType::FillRectangle;
+  command.pos1 = pos;
+  command.pos2 = { w, h };
+  command.color = color;
+  add(command, pos.x, pos.y, floor(pos.x) + ceil(w) - 1, floor(pos.y) + ceil(h) - 1);
+}
+
+void RenderQueue::add_circle(const Vector2d& pos, dim_t r, uint32_t color)
+{
+  // Circles of integral radius are stamped from the stamp cache
+  if (std::abs(pos.x) < 1 << 20 && std::abs(pos.y) < 1 << 20
+    && r == floor(r) && r >= 0 && r < 1 << 12)
+  {
+    if (int(r) != circle_stamp_size_)
+    {
+      circle_stamp_ = &Geometry::get_stamp(StampShape::Circle, int(r));
+      circle_stamp_size_ = int(r);
+    }
+    add_mask(*circle_stamp_, int(floor(pos.x)), int(floor(pos.y)), color);
+    return;
+  }
+
+  DrawCommand command;
+  command.type = DrawCommandType::Circle;
+  command.pos1 = pos;
+  command.size = r;
+  command.color = color;
+  dim_t n = ceil(r);
+  add(command, pos.x - n, pos.y - n, pos.x + n, pos.y + n);
+}
+
+void RenderQueue::add_digit(const Vector2d& pos, uint32_t digit, dim_t size, uint32_t color)
+{
+  // Digits at integral positions are stamped from the glyph atlas
+  if (pos.x == floor(pos.x) && pos.y == floor(pos.y) && std::abs(pos.x) < 1 << 20
+    && std::abs(pos.y) < 1 << 20 && size == floor(size) && size >= 0 && size < 1 << 12)
+  {
+    if (int(size) != glyph_size_)
+    {
+      std::fill(std::begin(glyphs_), std::end(glyphs_), nullptr);
+      glyph_size_ = int(size);
+    }
+    // get_digit_glyph throws for digits past 9
+    const SpanMask* glyph = digit < 10 ? glyphs_[digit] : nullptr;
+    if (!glyph)
+    {
+      glyph = &Geometry::get_digit_glyph(digit, int(size));
+      glyphs_[digit] = glyph;
+    }
+    add_mask(*glyph, int(pos.x), int(pos.y), color);
+    return;
+  }
+
+  DrawCommand command;
+  command.type = DrawCommandType::Digit;
+  command.pos1 = pos;
+  command.digit = digit;
+  command.size = size;
+  command.color = color;
+  add(command, pos.x - size, pos.y, pos.x, pos.y + 2 * size);
+}
+
+void RenderQueue::add_mask(const SpanMask& mask, int x, int y, uint32_t color)
+{
+  DrawCommand command;
+  command.type = DrawCommandType::Mask;
+  command.pos1 = { dim_t(x), dim_t(y) };
+  command.mask = &mask;
+  command.color = color;
+  add(command, dim_t(x + mask.bounds.x0), dim_t(y + mask.bounds.y0),
+    dim_t(x + mask.bounds.x1 - 1), dim_t(y + mask.bounds.y1 - 1));
+}
+
+void RenderQueue::add_mask(const std::shared_ptr<const SpanMask>& mask, int x, int y, uint32_t color)
+{
+  masks_.push_back(mask);
+  add_mask(*mask, x, y, color);
+}
+
+const std::vector<DrawCommand>& RenderQueue::get_commands() const
+{
+  return commands_;
+}
+
+Renderer::Renderer(JobSystem& jobs)
+  : jobs_(jobs)
+{
+  TaskGraph::Task bin_task = tasks_.add("bin", [this]()
+  {
+    if (tiled_)
+      bin(*queue_);
+  });
+  tasks_.add("rasterize", [this]() { rasterize(); }, { bin_task });
+}
+
+void Renderer::reserve(size_t count)
+{
+  tile_commands_.reserve(4 * count);
+}
+
+void Renderer::set_full_clear_threshold(float threshold)
+{
+  full_clear_threshold_ = threshold;
+}
+
+void Renderer::invalidate()
+{
+  full_clear_ = true;
+}
+
+void Renderer::render(const RenderQueue& queue, uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH])
+{
+  std::fill(next_dirty_cells_.begin(), next_dirty_cells_.end(), 0);
+  next_dirty_count_ = 0;
+  queue_ = &queue;
+  buffer_ = buffer;
+  tiled_ = jobs_.get_thread_count() > 1;
+  tasks_.run(jobs_);
+
+  dirty_cells_.swap(next_dirty_cells_);
+  full_clear_ = next_dirty_count_ > full_clear_threshold_ * dirty_cells_.size();
+}
+
+void Renderer::present(const uint32_t src[SCREEN_HEIGHT][SCREEN_WIDTH],
+  uint32_t dst[SCREEN_HEIGHT][SCREEN_WIDTH]) const
+{
+  for (int cy = 0; cy < cell_rows_; ++cy)
+  {
+    const uint8_t* current = &dirty_cells_[cy * cell_cols_];
+    const uint8_t* previous = &next_dirty_cells_[cy * cell_cols_];
+    int y1 = std::min((cy + 1) * cell_size_, SCREEN_HEIGHT);
+    for (int cx = 0; cx < cell_cols_; ++cx)
+    {
+      if (!current[cx] && !previous[cx])
+        continue;
+
+      int run_end = cx + 1;
+      while (run_end < cell_cols_ && (current[run_end] || previous[run_end]))
+        ++run_end;
+
+      int x0 = cx * cell_size_;
+      int x1 = std::min(run_end * cell_size_, SCREEN_WIDTH);
+      for (int y = cy * cell_size_; y < y1; ++y)
+        std::copy(src[y] + x0, src[y] + x1, dst[y] + x0);
+      cx = run_end;
+    }
+  }
+}
+
+void Renderer::mark_dirty(const ClipRect& bounds)
+{
+  for (int cy = bounds.y0 / cell_size_; cy <= (bounds.y1 - 1) / cell_size_; ++cy)
+  {
+    uint8_t* row = &next_dirty_cells_[cy * cell_cols_];
+    for (int cx = bounds.x0 / cell_size_; cx <= (bounds.x1 - 1) / cell_size_; ++cx)
+    {
+      next_dirty_count_ += !row[cx];
+      row[cx] = 1;
+    }
+  }
+}
+
+// Clears the cells of region that the previous frame drew into,
+// region must be aligned to cells
+void Renderer::clear_dirty(const ClipRect& region)
+{
+  if (full_clear_)
+  {
+    for (int y = region.y0; y < region.y1; ++y)
+      std::fill(buffer_[y] + region.x0, buffer_[y] + region.x1, 0);
+    return;
+  }
+
+  int cx0 = region.x0 / cell_size_;
+  int cx1 = (region.x1 + cell_size_ - 1) / cell_size_;
+  for (int cy = region.y0 / cell_size_; cy * cell_size_ < region.y1; ++cy)
+  {
+    const uint8_t* row = &dirty_cells_[cy * cell_cols_];
+    int y1 = std::min((cy + 1) * cell_size_, region.y1);
+    for (int cx = cx0; cx < cx1; ++cx)
+    {
+      if (!row[cx])
+        continue;
+
+      int run_end = cx + 1;
+      while (run_end < cx1 && row[run_end])
+        ++run_end;
+
+      int x0 = cx * cell_size_;
+      int x1 = std::min(run_end * cell_size_, region.x1);
+      for (int y = cy * cell_size_; y < y1; ++y)
+        std::fill(buffer_[y] + x0, buffer_[y] + x1, 0);
+      cx = run_end;
+    }
+  }
+}
+
+void Renderer::bin(const RenderQueue& queue)
+{
+  // Counting sort of the commands into tiles, one array for all of them
+  std::fill(tile_start_.begin(), tile_start_.end(), 0);
+  const auto& commands = queue.get_commands();
+  for (const auto& command : commands)
+  {
+    const ClipRect& bounds = command.bounds;
+    mark_dirty(bounds);
+    for (int ty = bounds.y0 / tile_size_; ty <= (bounds.y1 - 1) / tile_size_; ++ty)
+    {
+      for (int tx = bounds.x0 / tile_size_; tx <= (bounds.x1 - 1) / tile_size_; ++tx)
+        ++tile_start_[ty * tile_cols_ + tx + 1];
+    }
+  }
+  for (size_t t = 1; t < tile_start_.size(); ++t)
+    tile_start_[t] += tile_start_[t - 1];
+
+  tile_commands_.resize(tile_start_.back());
+  for (size_t i = 0; i < commands.size(); ++i)
+  {
+    const ClipRect& bounds = commands[i].bounds;
+    for (int ty = bounds.y0 / tile_size_; ty <= (bounds.y1 - 1) / tile_size_; ++ty)
+    {
+      for (int tx = bounds.x0 / tile_size_; tx <= (bounds.x1 - 1) / tile_size_; ++tx)
+        tile_commands_[tile_start_[ty * tile_cols_ + tx]++] = uint32_t(i);
+    }
+  }
+  // Filling advanced every start to the next tile's start, shift them back
+  for (size_t t = tile_start_.size() - 1; t > 0; --t)
+    tile_start_[t] = tile_start_[t - 1];
+  tile_start_[0] = 0;
+}
+
+void Renderer::rasterize()
+{
+  if (!tiled_)
+  {
+    clear_dirty(ClipRect());
+    for (const auto& command : queue_->get_commands())
+    {
+      mark_dirty(command.bounds);
+      command.execute(*queue_, buffer_, ClipRect());
+    }
+    return;
+  }
+
+  jobs_.parallel_for(tile_cols_ * tile_rows_, tile_chunk_, [this](size_t begin, size_t end, unsigned)
+  {
+    rasterize_tiles(int(begin), int(end));
+  });
+}
+
+void Renderer::rasterize_tiles(int first, int last)
+{
+  const auto& commands = queue_->get_commands();
+  for (int tile = first; tile < last; ++tile)
+  {
+    ClipRect clip;
+    clip.x0 = tile % tile_cols_ * tile_size_;
+    clip.y0 = tile / tile_cols_ * tile_size_;
+    clip.x1 = std::min(clip.x0 + tile_size_, SCREEN_WIDTH);
+    clip.y1 = std::min(clip.y0 + tile_size_, SCREEN_HEIGHT);
+    clear_dirty(clip);
+    for (uint32_t i = tile_start_[tile]; i < tile_start_[tile + 1]; ++i)
+      commands[tile_commands_[i]].execute(*queue_, buffer_, clip);
+  }
+}
+
+RenderPipeline::~RenderPipeline()
+{
+  set_enabled(false);
+}
+
+void RenderPipeline::set_enabled(bool enabled)
+{
+  if (enabled == is_enabled())
+    return;
+
+  if (enabled)
+  {
+    back_buffer_.assign(SCREEN_HEIGHT * SCREEN_WIDTH, 0);
+    has_frame_ = false;
+    presented_ = false;
+    renderer_.invalidate();
+    enabled_ = true;
+    return;
+  }
+
+  wait();
+  enabled_ = false;
+  back_buffer_.clear();
+  back_buffer_.shrink_to_fit();
+  renderer_.invalidate();
+}
+
+bool RenderPipeline::is_enabled() const
+{
+  return enabled_;
+}
+
+void RenderPipeline::reserve(size_t count)
+{
+  // Reserving may move the commands of the queue being rasterized
+  wait();
+  queues_[0].reserve(count);
+  queues_[1].reserve(count);
+}
+
+RenderQueue& RenderPipeline::get_record_queue()
+{
+  RenderQueue& queue = queues_[recording_];
+  queue.clear();
+  return queue;
+}
+
+void RenderPipeline::present(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH])
+{
+  wait();
+  if (has_frame_)
+  {
+    if (presented_)
+      renderer_.present(get_back_buffer(), buffer);
+    else
+      std::copy(back_buffer_.begin(), back_buffer_.end(), &buffer[0][0]);
+    presented_ = true;
+  }
+
+  recording_ ^= 1;
+  has_frame_ = true;
+  jobs_.submit(&RenderPipeline::render_job, this, 0, 1, rendering_);
+}
+
+uint32_t (*RenderPipeline::get_back_buffer())[SCREEN_WIDTH]
+{
+  return reinterpret_cast<uint32_t(*)[SCREEN_WIDTH]>(back_buffer_.data());
+}
+
+void RenderPipeline::wait()
+{
+  jobs_.wait(rendering_);
+}
+
+void RenderPipeline::render_job(void* pipeline, size_t, size_t, unsigned)
+{
+  RenderPipeline& self = *static_cast<RenderPipeline*>(pipeline);
+  // The queue recorded before the last present, the other one is being recorded
+  self.renderer_.render(self.queues_[self.recording_ ^ 1], self.get_back_buffer());
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include "Engine.h"
+#include "Utility.h"
+#include "Geometry.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+#include <vector>
+#include <memory>
+
+enum class DrawCommandType
+{
+  Line,
+  FillRectangle,
+  Circle,
+  Digit,
+  Mask,
+  Lines,
+};
+
+class RenderQueue;
+
+struct DrawCommand
+{
+  DrawCommandType type = DrawCommandType::Line;
+  Vector2d pos1 = { 0, 0 };
+  Vector2d pos2 = { 0, 0 };   // Line end, width and height of rectangle
+  dim_t size = 0;             // Circle radius, digit size
+  uint32_t digit = 0;
+  const SpanMask* mask = nullptr;   // Stamped at the integral pos1
+  uint32_t first_line = 0;    // Lines [first_line, first_line + line_count) of the queue
+  uint32_t line_count = 0;
+  uint32_t color = COLOR::WHITE;
+  ClipRect bounds = {};       // Screen pixels the command can touch
+
+  // queue is the one the command was recorded into
+  void execute(const RenderQueue& queue, uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH],
+    const ClipRect& clip) const;
+};
+
+// Draw calls of one frame, recorded in submission order. The queue is a
+// self-contained snapshot: it can be rasterized on another thread while the
+// game state it was recorded from keeps changing.
+class RenderQueue
+{
+  static const uint32_t max_batch_lines_ = 32;
+  static constexpr dim_t max_batch_extent_ = 32;    // Width and height of the bounds of a batch
+
+  std::vector<DrawCommand> commands_ = {};
+  std::vector<std::shared_ptr<const SpanMask>> masks_ = {};   // Kept alive until clear()
+  std::vector<Vector2d> line_ends_ = {};        // Two per line of the Lines commands
+  DrawCommand batch_ = {};                      // Lines command being recorded
+  Vector2d batch_min_ = { 0, 0 };
+  Vector2d batch_max_ = { 0, 0 };
+  // Masks of the last stamp and glyph size looked up, the shared caches take a lock
+  int circle_stamp_size_ = -1;
+  const SpanMask* circle_stamp_ = nullptr;
+  int glyph_size_ = -1;
+  const SpanMask* glyphs_[10] = {};
+  void add(DrawCommand& command, dim_t min_x, dim_t min_y, dim_t max_x, dim_t max_y);
+  void flush_lines();
+public:
+  void clear();
+  // Room for count commands and count batched lines without allocating
+  void reserve(size_t count);
+  void add_line(const Vector2d& pos1, const Vector2d& pos2, uint32_t color);
+  // Lines added between begin_lines() and end_lines() are recorded as commands of up
+  // to max_batch_lines_ lines each, which are binned and drawn as one. Lines added
+  // one after the other are mostly close to each other, e.g. the pieces of a ship.
+  void begin_lines(uint32_t color);
+  void add_batch_line(const Vector2d& pos1, const Vector2d& pos2);
+  void end_lines();
+  // Lines between consecutive vertices and from the first vertex to the last
+  void add_outline(const Polygon& polygon, uint32_t color);
+  void add_fill_rectangle(const Vector2d& pos, dim_t h, dim_t w, uint32_t color);
+  void add_circle(const Vector2d& pos, dim_t r, uint32_t color);
+  void add_digit(const Vector2d& pos, uint32_t digit, dim_t size, uint32_t color);
+  // mask must outlive rendering of the queue, e.g. a cached glyph or stamp
+  void add_mask(const SpanMask& mask, int x, int y, uint32_t color);
+  void add_mask(const std::shared_ptr<const SpanMask>& mask, int x, int y, uint32_t color);
+
+  const std::vector<DrawCommand>& get_commands() const;
+  const Vector2d* get_line_ends() const { return line_ends_.data(); }
+};
+
+// Rasterizes a RenderQueue into the backbuffer. When the job system has more
+// than one thread the commands are binned into screen tiles and every tile is
+// drawn by a single job clipped to the tile, so the result is identical to the
+// serial path. Binning and rasterization are tasks of a graph and timed.
+// Instead of clearing the whole buffer every frame only the cells touched by
+// the previous frame are cleared, unless they cover most of the screen.
+class Renderer
+{
+  static const int tile_size_ = 64;
+  static const int tile_cols_ = (SCREEN_WIDTH + tile_size_ - 1) / tile_size_;
+  static const int tile_rows_ = (SCREEN_HEIGHT + tile_size_ - 1) / tile_size_;
+  static const int cell_size_ = 16;       // Dirty tracking granularity, divides tile_size_
+  static const int cell_cols_ = (SCREEN_WIDTH + cell_size_ - 1) / cell_size_;
+  static const int cell_rows_ = (SCREEN_HEIGHT + cell_size_ - 1) / cell_size_;
+
+  static const int tile_chunk_ = 2;       // Tiles per job
+
+  JobSystem& jobs_;
+  TaskGraph tasks_;
+  bool tiled_ = false;                    // Of the current render
+  // Commands of every tile in submission order, tile t at [tile_start_[t], tile_start_[t + 1])
+  std::vector<uint32_t> tile_start_ = std::vector<uint32_t>(tile_cols_ * tile_rows_ + 1);
+  std::vector<uint32_t> tile_commands_ = {};
+
+  float full_clear_threshold_ = 0.5;      // Fraction of dirty cells to fall back to a full clear
+  bool full_clear_ = true;
+  std::vector<uint8_t> dirty_cells_ = std::vector<uint8_t>(cell_cols_ * cell_rows_);
+  std::vector<uint8_t> next_dirty_cells_ = std::vector<uint8_t>(cell_cols_ * cell_rows_);
+  size_t next_dirty_count_ = 0;
+
+  const RenderQueue* queue_ = nullptr;
+  uint32_t (*buffer_)[SCREEN_WIDTH] = nullptr;
+
+  void mark_dirty(const ClipRect& bounds);
+  void clear_dirty(const ClipRect& region);
+  void bin(const RenderQueue& queue);
+  void rasterize_tiles(int first, int last);
+  void rasterize();
+public:
+  explicit Renderer(JobSystem& jobs);
+  Renderer(const Renderer&) = delete;
+  Renderer& operator=(const Renderer&) = delete;
+
+  // Room to bin count commands without allocating, assuming a few tiles per command
+  void reserve(size_t count);
+  void set_full_clear_threshold(float threshold);
+  // Forces a full clear on the next frame, e.g. after the buffer was written elsewhere
+  void invalidate();
+
+  void render(const RenderQueue& queue, uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]);
+  // Copies the cells changed by the last two renders from src, where they were
+  // rendered, to dst, which must hold the frame rendered before the last one
+  void present(const uint32_t src[SCREEN_HEIGHT][SCREEN_WIDTH],
+    uint32_t dst[SCREEN_HEIGHT][SCREEN_WIDTH]) const;
+
+  // Binning and rasterization, with their times
+  const TaskGraph& get_tasks() const { return tasks_; }
+};
+
+// Rasterizes the snapshot recorded for frame N in a job into a private back
+// buffer while frame N + 1 is simulated. Presenting waits for the snapshot to
+// finish and copies it to the backbuffer, so the displayed frame lags the
+// simulation by one. The job overlaps the simulation only when the job system
+// has a thread to spare, otherwise it runs when present() waits for it.
+class RenderPipeline
+{
+  Renderer& renderer_;
+  JobSystem& jobs_;
+  RenderQueue queues_[2];
+  int recording_ = 0;
+  std::vector<uint32_t> back_buffer_ = {};
+  bool has_frame_ = false;    // A snapshot was submitted since the pipeline was enabled
+  bool presented_ = false;    // Backbuffer holds the previously presented frame
+  bool enabled_ = false;
+  JobCounter rendering_;
+
+  uint32_t (*get_back_buffer())[SCREEN_WIDTH];
+  void wait();
+  static void render_job(void* pipeline, size_t, size_t, unsigned);
+public:
+  RenderPipeline(Renderer& renderer, JobSystem& jobs) : renderer_(renderer), jobs_(jobs) {}
+  RenderPipeline(const RenderPipeline&) = delete;
+  RenderPipeline& operator=(const RenderPipeline&) = delete;
+  ~RenderPipeline();
+
+  void set_enabled(bool enabled);
+  bool is_enabled() const;
+  // Reserves count commands in both queues
+  void reserve(size_t count);
+
+  // Cleared queue to record the snapshot of the frame just simulated
+  RenderQueue& get_record_queue();
+  // Presents the previous snapshot and starts rasterizing the recorded one
+  void present(uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH]);
+};
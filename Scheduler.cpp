@@ -0,0 +1,62 @@
+#include "Scheduler.h"
+#include <algorithm>
+
+bool Scheduler::is_later(const Entry& a, const Entry& b)
+{
+  return a.time > b.time || (a.time == b.time && a.sequence > b.sequence);
+}
+
+void Scheduler::release(uint32_t slot)
+{
+  callbacks_[slot] = Callback();
+  free_slots_.push_back(slot);
+}
+
+void Scheduler::schedule(float delay, Callback callback)
+{
+  uint32_t slot;
+  if (free_slots_.empty())
+  {
+    slot = uint32_t(callbacks_.size());
+    callbacks_.emplace_back();
+  }
+  else
+  {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+  callbacks_[slot] = std::move(callback);
+
+  heap_.push_back({ now_ + delay, sequence_++, slot });
+  std::push_heap(heap_.begin(), heap_.end(), is_later);
+}
+
+void Scheduler::advance(float dt)
+{
+  now_ += dt;
+  while (!heap_.empty() && heap_.front().time <= now_)
+  {
+    Entry entry = heap_.front();
+    std::pop_heap(heap_.begin(), heap_.end(), is_later);
+    heap_.pop_back();
+
+    // Released before the call, the callback may reuse the slot
+    Callback callback = std::move(callbacks_[entry.slot]);
+    release(entry.slot);
+    callback();
+  }
+}
+
+void Scheduler::reserve(size_t count)
+{
+  heap_.reserve(count);
+  callbacks_.reserve(count);
+  free_slots_.reserve(count);
+}
+
+void Scheduler::clear()
+{
+  for (const auto& entry : heap_)
+    release(entry.slot);
+  heap_.clear();
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Callback.h"
+
+// Callbacks to run at a given game time, kept in a min-heap on that time, so
+// advancing the clock costs only as much as the callbacks that are due.
+// Callbacks due at the same time run in the order they were scheduled.
+// There is no cancelling a single callback: effects on an entity check its
+// handle when they run and do nothing once it went stale.
+class Scheduler
+{
+  struct Entry
+  {
+    double time;
+    uint64_t sequence;
+    uint32_t slot;
+  };
+
+  double now_ = 0;
+  uint64_t sequence_ = 0;
+  std::vector<Entry> heap_ = {};
+  std::vector<Callback> callbacks_ = {};        // By slot
+  std::vector<uint32_t> free_slots_ = {};
+
+  static bool is_later(const Entry& a, const Entry& b);
+  void release(uint32_t slot);
+public:
+  // Runs callback delay seconds of game time from now
+  void schedule(float delay, Callback callback);
+  // Advances the clock by dt and runs the callbacks due, including the ones they
+  // schedule within the same time. Callbacks may schedule and clear.
+  void advance(float dt);
+  // Cancels everything, the clock keeps running
+  void clear();
+  // Room for count pending callbacks without allocating
+  void reserve(size_t count);
+
+  double get_time() const { return now_; }
+  size_t size() const { return heap_.size(); }
+};
@@ -0,0 +1,92 @@
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(dim_t cell_size)
+  : cell_size_(cell_size),
+  cols_(int(ceil(SCREEN_WIDTH / cell_size))),
+  rows_(int(ceil(SCREEN_HEIGHT / cell_size))),
+  cell_start_(cols_ * rows_ + 1)
+{}
+
+int SpatialGrid::get_col(dim_t x) const
+{
+  dim_t col = floor(x / cell_size_);
+  if (!(col >= 0))
+    return 0;
+  if (col >= cols_)
+    return cols_ - 1;
+  return int(col);
+}
+
+int SpatialGrid::get_row(dim_t y) const
+{
+  dim_t row = floor(y / cell_size_);
+  if (!(row >= 0))
+    return 0;
+  if (row >= rows_)
+    return rows_ - 1;
+  return int(row);
+}
+
+void SpatialGrid::clear()
+{
+  items_.clear();
+}
+
+void SpatialGrid::reserve(uint32_t count)
+{
+  items_.reserve(count);
+  cell_ids_.reserve(4 * count);
+}
+
+void SpatialGrid::insert(uint32_t id, const Vector2d& min, const Vector2d& max)
+{
+  items_.push_back({ id, get_col(min.x), get_row(min.y), get_col(max.x), get_row(max.y) });
+}
+
+void SpatialGrid::build()
+{
+  // Counting sort of the items into cells
+  std::fill(cell_start_.begin(), cell_start_.end(), 0);
+  for (const auto& item : items_)
+  {
+    for (int row = item.y0; row <= item.y1; ++row)
+    {
+      for (int col = item.x0; col <= item.x1; ++col)
+        ++cell_start_[row * cols_ + col + 1];
+    }
+  }
+  for (size_t i = 1; i < cell_start_.size(); ++i)
+    cell_start_[i] += cell_start_[i - 1];
+
+  cell_ids_.resize(cell_start_.back());
+  for (const auto& item : items_)
+  {
+    for (int row = item.y0; row <= item.y1; ++row)
+    {
+      for (int col = item.x0; col <= item.x1; ++col)
+        cell_ids_[cell_start_[row * cols_ + col]++] = item.id;
+    }
+  }
+  // Filling advanced every start to the next cell's start, shift them back
+  for (size_t i = cell_start_.size() - 1; i > 0; --i)
+    cell_start_[i] = cell_start_[i - 1];
+  cell_start_[0] = 0;
+}
+
+void SpatialGrid::query(const Vector2d& min, const Vector2d& max, std::vector<uint32_t>& result) const
+{
+  size_t first = result.size();
+  for (int row = get_row(min.y); row <= get_row(max.y); ++row)
+  {
+    for (int col = get_col(min.x); col <= get_col(max.x); ++col)
+    {
+      int cell = row * cols_ + col;
+      result.insert(result.end(), cell_ids_.begin() + cell_start_[cell], cell_ids_.begin() + cell_start_[cell + 1]);
+    }
+  }
+  // Objects spanning several cells of the box were found in each of them
+  std::sort(result.begin() + first, result.end());
+  result.erase(std::unique(result.begin() + first, result.end()), result.end());
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "Engine.h"
+#include "Utility.h"
+#include <vector>
+
+// Uniform grid over the screen for broad-phase collision. Objects are inserted
+// by their bounding box each frame, build() sorts them into cells, and query()
+// returns the objects whose cells overlap a box. Boxes outside the screen are
+// clamped to the border cells, which keeps queries conservative.
+class SpatialGrid
+{
+  struct Item
+  {
+    uint32_t id;
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+  };
+
+  dim_t cell_size_ = 64;
+  int cols_ = 0;
+  int rows_ = 0;
+  std::vector<Item> items_ = {};
+  std::vector<uint32_t> cell_start_ = {};   // Offsets into cell_ids_, one extra at the end
+  std::vector<uint32_t> cell_ids_ = {};
+
+  int get_col(dim_t x) const;
+  int get_row(dim_t y) const;
+public:
+  explicit SpatialGrid(dim_t cell_size);
+
+  void clear();
+  // Room for count objects without allocating, each in up to 4 cells
+  void reserve(uint32_t count);
+  void insert(uint32_t id, const Vector2d& min, const Vector2d& max);
+  void build();
+  // Appends ids of objects that may overlap the box to result in ascending order.
+  // result needs room for the ids of all cells of the box, duplicates included.
+  // Only reads the grid, so several threads may query at once.
+  void query(const Vector2d& min, const Vector2d& max, std::vector<uint32_t>& result) const;
+};
@@ -0,0 +1,54 @@
+#include "TaskGraph.h"
+#include <chrono>
+#include <stdexcept>
+
+TaskGraph::Task TaskGraph::add(const char* name, Callback work, std::initializer_list<Task> dependencies)
+{
+  Task task = Task(nodes_.size());
+  for (Task dependency : dependencies)
+  {
+    if (dependency >= task)
+      throw std::invalid_argument("TaskGraph dependencies must be added before their dependents");
+  }
+
+  nodes_.emplace_back(new Node());
+  Node& node = *nodes_.back();
+  node.name = name;
+  node.work = std::move(work);
+  node.dependency_count = uint32_t(dependencies.size());
+  for (Task dependency : dependencies)
+    nodes_[dependency]->dependents.push_back(task);
+  return task;
+}
+
+void TaskGraph::run(JobSystem& jobs)
+{
+  jobs_ = &jobs;
+  for (auto& node : nodes_)
+    node->waiting.store(node->dependency_count, std::memory_order_relaxed);
+  for (Task task = 0; task < nodes_.size(); ++task)
+  {
+    if (nodes_[task]->dependency_count == 0)
+      jobs.submit(&run_node, this, task, task + 1, running_);
+  }
+  jobs.wait(running_);
+  ++run_count_;
+}
+
+void TaskGraph::run_node(void* graph, size_t task, size_t, unsigned)
+{
+  typedef std::chrono::steady_clock clock;
+  TaskGraph& self = *static_cast<TaskGraph*>(graph);
+  Node& node = *self.nodes_[task];
+  clock::time_point start = clock::now();
+  node.work();
+  node.last_time = std::chrono::duration<double>(clock::now() - start).count();
+  node.total_time += node.last_time;
+
+  // Dependents are submitted before this job counts as done, so the run cannot end early
+  for (Task dependent : node.dependents)
+  {
+    if (self.nodes_[dependent]->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      self.jobs_->submit(&run_node, graph, dependent, dependent + 1, self.running_);
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <initializer_list>
+#include "Callback.h"
+#include "JobSystem.h"
+
+// Work of a frame split into named tasks and what each of them waits for,
+// declared once and run every frame on a JobSystem: a task starts as soon as
+// the tasks it depends on are done, so independent tasks run in parallel.
+// Declaring allocates, running does not. The time of every task is measured.
+class TaskGraph
+{
+public:
+  typedef uint32_t Task;
+private:
+  struct Node
+  {
+    const char* name;
+    Callback work;
+    std::vector<Task> dependents = {};
+    uint32_t dependency_count = 0;
+    std::atomic<uint32_t> waiting = { 0 };    // Dependencies not done in this run
+    double last_time = 0;                     // Seconds
+    double total_time = 0;
+  };
+
+  std::vector<std::unique_ptr<Node>> nodes_ = {};
+  JobSystem* jobs_ = nullptr;     // Of the current run
+  JobCounter running_;
+  uint64_t run_count_ = 0;
+
+  static void run_node(void* graph, size_t task, size_t, unsigned);
+public:
+  // Task running work once all dependencies, added before, are done
+  Task add(const char* name, Callback work, std::initializer_list<Task> dependencies = {});
+  // Runs every task once and returns when all are done
+  void run(JobSystem& jobs);
+
+  size_t size() const { return nodes_.size(); }
+  const char* get_name(Task task) const { return nodes_[task]->name; }
+  // Seconds the task took in the last run and in all runs together
+  double get_last_time(Task task) const { return nodes_[task]->last_time; }
+  double get_total_time(Task task) const { return nodes_[task]->total_time; }
+  uint64_t get_run_count() const { return run_count_; }
+};
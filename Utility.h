@@ -1,5 +1,6 @@
 #pragma once
 #include<cmath>
+#include <cstddef>
 #include <cstdint>
 
 #define PI 3.14159265
@@ -24,10 +25,10 @@ public:
   Vector2d operator/ (dim_t value) const { return { x / value, y / value }; }
   Vector2d rotate(const Vector2d& r, float angle) const
   {
+    dim_t c = std::cos(angle);
+    dim_t s = std::sin(angle);
     Vector2d r0 = Vector2d(x - r.x, y - r.y);
-    dim_t r0_x = r0.x * cos(angle) - r0.y * sin(angle);
-    dim_t r0_y = r0.x * sin(angle) + r0.y * cos(angle);
-    return { r.x + r0_x, r.y + r0_y };
+    return { r.x + r0.x * c - r0.y * s, r.y + r0.x * s + r0.y * c };
   }
   Vector2d get_normalized() const
   {
@@ -45,5 +46,31 @@ public:
   {
     return sqrt(x * x + y * y);
   }
-  ~Vector2d() {}
 };
+
+// Point a fraction t of the way from a to b
+inline Vector2d lerp(const Vector2d& a, const Vector2d& b, float t)
+{
+  return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+}
+
+// Angle a fraction t of the way from a to b the short way round, so that
+// going from just below pi to just above -pi does not turn all the way back
+inline float lerp_angle(float a, float b, float t)
+{
+  return a + std::remainder(b - a, float(2 * PI)) * t;
+}
+
+// Rotates count points around r by angle, with one sin/cos pair for all of them
+inline void rotate_many(Vector2d* points, size_t count, const Vector2d& r, float angle)
+{
+  dim_t c = std::cos(angle);
+  dim_t s = std::sin(angle);
+  for (size_t i = 0; i < count; ++i)
+  {
+    dim_t r0_x = points[i].x - r.x;
+    dim_t r0_y = points[i].y - r.y;
+    points[i].x = r.x + r0_x * c - r0_y * s;
+    points[i].y = r.y + r0_x * s + r0_y * c;
+  }
+}